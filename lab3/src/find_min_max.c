@@ -2,7 +2,13 @@
 
 #include <limits.h>
 
-struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
+#include <immintrin.h>
+
+typedef struct MinMax (*MinMaxKernel)(int *array, unsigned int begin,
+                                      unsigned int end);
+
+static struct MinMax GetMinMaxScalar(int *array, unsigned int begin,
+                                     unsigned int end) {
   struct MinMax min_max;
   min_max.min = INT_MAX;
   min_max.max = INT_MIN;
@@ -15,6 +21,187 @@ struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
       min_max.max = array[i];
     }
   }
-  
+
+  return min_max;
+}
+
+// Merges the tail that did not fill a whole vector iteration.
+static struct MinMax FinishScalar(struct MinMax min_max, int *array,
+                                  unsigned int begin, unsigned int end) {
+  struct MinMax tail = GetMinMaxScalar(array, begin, end);
+  if (tail.min < min_max.min) min_max.min = tail.min;
+  if (tail.max > min_max.max) min_max.max = tail.max;
   return min_max;
 }
+
+__attribute__((target("sse4.1")))
+static struct MinMax GetMinMaxSSE41(int *array, unsigned int begin,
+                                    unsigned int end) {
+  __m128i min0 = _mm_set1_epi32(INT_MAX), max0 = _mm_set1_epi32(INT_MIN);
+  __m128i min1 = min0, min2 = min0, min3 = min0;
+  __m128i max1 = max0, max2 = max0, max3 = max0;
+
+  unsigned int i = begin;
+  for (; i + 16 <= end; i += 16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(array + i));
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(array + i + 4));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(array + i + 8));
+    __m128i v3 = _mm_loadu_si128((const __m128i *)(array + i + 12));
+    min0 = _mm_min_epi32(min0, v0);
+    min1 = _mm_min_epi32(min1, v1);
+    min2 = _mm_min_epi32(min2, v2);
+    min3 = _mm_min_epi32(min3, v3);
+    max0 = _mm_max_epi32(max0, v0);
+    max1 = _mm_max_epi32(max1, v1);
+    max2 = _mm_max_epi32(max2, v2);
+    max3 = _mm_max_epi32(max3, v3);
+  }
+
+  __m128i min = _mm_min_epi32(_mm_min_epi32(min0, min1), _mm_min_epi32(min2, min3));
+  __m128i max = _mm_max_epi32(_mm_max_epi32(max0, max1), _mm_max_epi32(max2, max3));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(1, 0, 3, 2)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  struct MinMax min_max;
+  min_max.min = _mm_cvtsi128_si32(min);
+  min_max.max = _mm_cvtsi128_si32(max);
+  return FinishScalar(min_max, array, i, end);
+}
+
+__attribute__((target("avx2")))
+static struct MinMax GetMinMaxAVX2(int *array, unsigned int begin,
+                                   unsigned int end) {
+  __m256i min0 = _mm256_set1_epi32(INT_MAX), max0 = _mm256_set1_epi32(INT_MIN);
+  __m256i min1 = min0, min2 = min0, min3 = min0;
+  __m256i max1 = max0, max2 = max0, max3 = max0;
+
+  unsigned int i = begin;
+  for (; i + 32 <= end; i += 32) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(array + i));
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(array + i + 8));
+    __m256i v2 = _mm256_loadu_si256((const __m256i *)(array + i + 16));
+    __m256i v3 = _mm256_loadu_si256((const __m256i *)(array + i + 24));
+    min0 = _mm256_min_epi32(min0, v0);
+    min1 = _mm256_min_epi32(min1, v1);
+    min2 = _mm256_min_epi32(min2, v2);
+    min3 = _mm256_min_epi32(min3, v3);
+    max0 = _mm256_max_epi32(max0, v0);
+    max1 = _mm256_max_epi32(max1, v1);
+    max2 = _mm256_max_epi32(max2, v2);
+    max3 = _mm256_max_epi32(max3, v3);
+  }
+
+  __m256i min256 = _mm256_min_epi32(_mm256_min_epi32(min0, min1),
+                                    _mm256_min_epi32(min2, min3));
+  __m256i max256 = _mm256_max_epi32(_mm256_max_epi32(max0, max1),
+                                    _mm256_max_epi32(max2, max3));
+  __m128i min = _mm_min_epi32(_mm256_castsi256_si128(min256),
+                              _mm256_extracti128_si256(min256, 1));
+  __m128i max = _mm_max_epi32(_mm256_castsi256_si128(max256),
+                              _mm256_extracti128_si256(max256, 1));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(1, 0, 3, 2)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  struct MinMax min_max;
+  min_max.min = _mm_cvtsi128_si32(min);
+  min_max.max = _mm_cvtsi128_si32(max);
+  return FinishScalar(min_max, array, i, end);
+}
+
+__attribute__((target("avx512f")))
+static struct MinMax GetMinMaxAVX512(int *array, unsigned int begin,
+                                     unsigned int end) {
+  __m512i min0 = _mm512_set1_epi32(INT_MAX), max0 = _mm512_set1_epi32(INT_MIN);
+  __m512i min1 = min0, min2 = min0, min3 = min0;
+  __m512i max1 = max0, max2 = max0, max3 = max0;
+
+  unsigned int i = begin;
+  for (; i + 64 <= end; i += 64) {
+    __m512i v0 = _mm512_loadu_si512(array + i);
+    __m512i v1 = _mm512_loadu_si512(array + i + 16);
+    __m512i v2 = _mm512_loadu_si512(array + i + 32);
+    __m512i v3 = _mm512_loadu_si512(array + i + 48);
+    min0 = _mm512_min_epi32(min0, v0);
+    min1 = _mm512_min_epi32(min1, v1);
+    min2 = _mm512_min_epi32(min2, v2);
+    min3 = _mm512_min_epi32(min3, v3);
+    max0 = _mm512_max_epi32(max0, v0);
+    max1 = _mm512_max_epi32(max1, v1);
+    max2 = _mm512_max_epi32(max2, v2);
+    max3 = _mm512_max_epi32(max3, v3);
+  }
+
+  __m512i min = _mm512_min_epi32(_mm512_min_epi32(min0, min1),
+                                 _mm512_min_epi32(min2, min3));
+  __m512i max = _mm512_max_epi32(_mm512_max_epi32(max0, max1),
+                                 _mm512_max_epi32(max2, max3));
+
+  struct MinMax min_max;
+  min_max.min = _mm512_reduce_min_epi32(min);
+  min_max.max = _mm512_reduce_max_epi32(max);
+  return FinishScalar(min_max, array, i, end);
+}
+
+static const MinMaxKernel kernels[MIN_MAX_IMPL_COUNT] = {
+    [MIN_MAX_SCALAR] = GetMinMaxScalar,
+    [MIN_MAX_SSE41] = GetMinMaxSSE41,
+    [MIN_MAX_AVX2] = GetMinMaxAVX2,
+    [MIN_MAX_AVX512] = GetMinMaxAVX512,
+};
+
+static const char *kernel_names[MIN_MAX_IMPL_COUNT] = {
+    [MIN_MAX_SCALAR] = "scalar",
+    [MIN_MAX_SSE41] = "sse4.1",
+    [MIN_MAX_AVX2] = "avx2",
+    [MIN_MAX_AVX512] = "avx512",
+};
+
+static enum MinMaxImpl selected_impl = MIN_MAX_SCALAR;
+
+// Runs once before main, so forked children and threads all see the final
+// choice without any synchronization.
+__attribute__((constructor))
+static void SelectMinMaxImpl(void) {
+  for (int impl = MIN_MAX_IMPL_COUNT - 1; impl > MIN_MAX_SCALAR; impl--) {
+    if (MinMaxImplSupported(impl)) {
+      selected_impl = impl;
+      return;
+    }
+  }
+}
+
+bool MinMaxImplSupported(enum MinMaxImpl impl) {
+  __builtin_cpu_init();
+  switch (impl) {
+    case MIN_MAX_SCALAR:
+      return true;
+    case MIN_MAX_SSE41:
+      return __builtin_cpu_supports("sse4.1");
+    case MIN_MAX_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case MIN_MAX_AVX512:
+      return __builtin_cpu_supports("avx512f");
+    default:
+      return false;
+  }
+}
+
+enum MinMaxImpl GetMinMaxImpl(void) { return selected_impl; }
+
+const char *MinMaxImplName(enum MinMaxImpl impl) {
+  if (impl < 0 || impl >= MIN_MAX_IMPL_COUNT) return "unknown";
+  return kernel_names[impl];
+}
+
+struct MinMax GetMinMaxWith(enum MinMaxImpl impl, int *array,
+                            unsigned int begin, unsigned int end) {
+  return kernels[impl](array, begin, end);
+}
+
+struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
+  return kernels[selected_impl](array, begin, end);
+}
@@ -1,8 +1,28 @@
 #ifndef FIND_MIN_MAX_H
 #define FIND_MIN_MAX_H
 
+#include <stdbool.h>
+
 #include "utils.h"
 
+// GetMinMax kernels, from slowest to fastest. The fastest one the CPU
+// supports is picked once at startup.
+enum MinMaxImpl {
+  MIN_MAX_SCALAR,
+  MIN_MAX_SSE41,
+  MIN_MAX_AVX2,
+  MIN_MAX_AVX512,
+  MIN_MAX_IMPL_COUNT
+};
+
 struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end);
 
+// Runs a specific kernel; impl must be supported by the CPU.
+struct MinMax GetMinMaxWith(enum MinMaxImpl impl, int *array,
+                            unsigned int begin, unsigned int end);
+
+bool MinMaxImplSupported(enum MinMaxImpl impl);
+enum MinMaxImpl GetMinMaxImpl(void);
+const char *MinMaxImplName(enum MinMaxImpl impl);
+
 #endif
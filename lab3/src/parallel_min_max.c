@@ -192,6 +192,7 @@ int main(int argc, char **argv) {
 
   printf("Min: %d\n", min_max.min);
   printf("Max: %d\n", min_max.max);
+  printf("Kernel: %s\n", MinMaxImplName(GetMinMaxImpl()));
   printf("Elapsed time: %fms\n", elapsed_time);
   fflush(NULL);
   return 0;
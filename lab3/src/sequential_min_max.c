@@ -1,22 +1,89 @@
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#include <getopt.h>
 
 #include "find_min_max.h"
+#include "stream.h"
 #include "utils.h"
 
+static int RunStream(bool binary, size_t chunk_size) {
+  struct StreamStats stats;
+  if (!StreamMinMax(STDIN_FILENO, binary, chunk_size, &stats)) {
+    return 1;
+  }
+  if (stats.count == 0) {
+    printf("No input values\n");
+    return 1;
+  }
+
+  printf("min: %d\n", stats.min_max.min);
+  printf("max: %d\n", stats.min_max.max);
+  printf("sum: %" PRId64 "\n", stats.sum);
+  printf("count: %" PRIu64 "\n", stats.count);
+  printf("kernel: %s\n", MinMaxImplName(GetMinMaxImpl()));
+  return 0;
+}
+
 int main(int argc, char **argv) {
-  if (argc != 3) {
+  bool stream = false;
+  bool binary = false;
+  long chunk_size = STREAM_DEFAULT_CHUNK;
+
+  while (true) {
+    static struct option options[] = {{"stream", no_argument, 0, 0},
+                                      {"binary", no_argument, 0, 0},
+                                      {"chunk", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+    if (c == -1) break;
+    if (c != 0) return 1;
+
+    switch (option_index) {
+      case 0:
+        stream = true;
+        break;
+      case 1:
+        binary = true;
+        break;
+      case 2:
+        chunk_size = atol(optarg);
+        if (chunk_size <= 0) {
+          printf("chunk is a positive number\n");
+          return 1;
+        }
+        break;
+    }
+  }
+
+  // --stream reads integers from stdin: native-endian int32 with --binary,
+  // whitespace-separated text otherwise.
+  if (stream) {
+    if (optind != argc) {
+      printf("Usage: %s --stream [--binary] [--chunk num] < input\n", argv[0]);
+      return 1;
+    }
+    return RunStream(binary, chunk_size);
+  }
+
+  if (argc - optind != 2) {
     printf("Usage: %s seed arraysize\n", argv[0]);
+    printf("       %s --stream [--binary] [--chunk num] < input\n", argv[0]);
     return 1;
   }
 
-  int seed = atoi(argv[1]);
+  int seed = atoi(argv[optind]);
   if (seed <= 0) {
     printf("seed is a positive number\n");
     return 1;
   }
 
-  int array_size = atoi(argv[2]);
+  int array_size = atoi(argv[optind + 1]);
   if (array_size <= 0) {
     printf("array_size is a positive number\n");
     return 1;
@@ -29,6 +96,7 @@ int main(int argc, char **argv) {
 
   printf("min: %d\n", min_max.min);
   printf("max: %d\n", min_max.max);
+  printf("kernel: %s\n", MinMaxImplName(GetMinMaxImpl()));
 
   return 0;
 }
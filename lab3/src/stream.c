@@ -0,0 +1,226 @@
+#include "stream.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "find_min_max.h"
+
+#define TEXT_READ_SIZE (1 << 16)
+
+struct Chunk {
+  int *values;
+  size_t count;
+  bool full;
+};
+
+// Two chunks handed back and forth: the reader fills chunks[i] while the
+// consumer reduces chunks[i ^ 1].
+struct Stream {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  struct Chunk chunks[2];
+  // Set by the reader after publishing its last chunk.
+  bool done;
+  bool failed;
+
+  int fd;
+  bool binary;
+  size_t chunk_size;
+
+  // Text parsing state, which carries over between reads and chunks.
+  char *text;
+  size_t text_pos;
+  size_t text_len;
+  bool in_number;
+  bool negative;
+  bool has_digits;
+  int64_t number;
+  bool eof;
+};
+
+// Reads until buffer is full or the input ends. Returns the byte count,
+// or -1 on error.
+static ssize_t ReadFully(int fd, void *buffer, size_t size) {
+  size_t filled = 0;
+  while (filled < size) {
+    ssize_t got = read(fd, (char *)buffer + filled, size - filled);
+    if (got == 0) break;
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    filled += got;
+  }
+  return filled;
+}
+
+static bool FillBinary(struct Stream *stream, struct Chunk *chunk) {
+  size_t bytes = stream->chunk_size * sizeof(int);
+  ssize_t got = ReadFully(stream->fd, chunk->values, bytes);
+  if (got < 0) {
+    perror("read");
+    return false;
+  }
+  if (got % sizeof(int) != 0) {
+    printf("Input ends with a partial %zu-byte value\n", sizeof(int));
+    return false;
+  }
+  chunk->count = got / sizeof(int);
+  stream->eof = (size_t)got < bytes;
+  return true;
+}
+
+static bool FinishNumber(struct Stream *stream, struct Chunk *chunk) {
+  stream->in_number = false;
+  if (!stream->has_digits) {
+    printf("Lone '-' in input\n");
+    return false;
+  }
+  int64_t value = stream->negative ? -stream->number : stream->number;
+  chunk->values[chunk->count++] = (int)value;
+  return true;
+}
+
+// Parses text into chunk until it holds chunk_size values or the input
+// ends. A number split across two reads is kept in the parsing state.
+static bool FillText(struct Stream *stream, struct Chunk *chunk) {
+  chunk->count = 0;
+  while (chunk->count < stream->chunk_size) {
+    if (stream->text_pos == stream->text_len) {
+      ssize_t got = read(stream->fd, stream->text, TEXT_READ_SIZE);
+      if (got < 0) {
+        if (errno == EINTR) continue;
+        perror("read");
+        return false;
+      }
+      if (got == 0) {
+        stream->eof = true;
+        return !stream->in_number || FinishNumber(stream, chunk);
+      }
+      stream->text_pos = 0;
+      stream->text_len = got;
+    }
+
+    char c = stream->text[stream->text_pos++];
+    if (c >= '0' && c <= '9') {
+      if (!stream->in_number) {
+        stream->in_number = true;
+        stream->negative = false;
+        stream->number = 0;
+      }
+      stream->has_digits = true;
+      stream->number = stream->number * 10 + (c - '0');
+      if (stream->number > (int64_t)INT_MAX + 1 ||
+          (!stream->negative && stream->number > INT_MAX)) {
+        printf("Value out of int range in input\n");
+        return false;
+      }
+    } else if (c == '-' && !stream->in_number) {
+      stream->in_number = true;
+      stream->negative = true;
+      stream->has_digits = false;
+      stream->number = 0;
+    } else if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+      if (stream->in_number && !FinishNumber(stream, chunk)) return false;
+    } else {
+      printf("Unexpected character '%c' in input\n", c);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void *ReaderThread(void *args) {
+  struct Stream *stream = (struct Stream *)args;
+  for (int i = 0;; i ^= 1) {
+    struct Chunk *chunk = &stream->chunks[i];
+    pthread_mutex_lock(&stream->lock);
+    while (chunk->full) {
+      pthread_cond_wait(&stream->changed, &stream->lock);
+    }
+    pthread_mutex_unlock(&stream->lock);
+
+    bool ok = stream->binary ? FillBinary(stream, chunk)
+                             : FillText(stream, chunk);
+
+    pthread_mutex_lock(&stream->lock);
+    chunk->full = ok;
+    stream->failed = !ok;
+    stream->done = !ok || stream->eof;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    if (stream->done) break;
+  }
+  return NULL;
+}
+
+static void ReduceChunk(const struct Chunk *chunk, struct StreamStats *stats) {
+  if (chunk->count == 0) return;
+  struct MinMax min_max = GetMinMax(chunk->values, 0, chunk->count);
+  if (min_max.min < stats->min_max.min) stats->min_max.min = min_max.min;
+  if (min_max.max > stats->min_max.max) stats->min_max.max = min_max.max;
+  int64_t sum = 0;
+  for (size_t i = 0; i < chunk->count; i++) {
+    sum += chunk->values[i];
+  }
+  stats->sum += sum;
+  stats->count += chunk->count;
+}
+
+bool StreamMinMax(int fd, bool binary, size_t chunk_size,
+                  struct StreamStats *stats) {
+  stats->min_max.min = INT_MAX;
+  stats->min_max.max = INT_MIN;
+  stats->sum = 0;
+  stats->count = 0;
+
+  struct Stream stream;
+  memset(&stream, 0, sizeof(stream));
+  pthread_mutex_init(&stream.lock, NULL);
+  pthread_cond_init(&stream.changed, NULL);
+  stream.fd = fd;
+  stream.binary = binary;
+  stream.chunk_size = chunk_size;
+  stream.chunks[0].values = malloc(sizeof(int) * chunk_size);
+  stream.chunks[1].values = malloc(sizeof(int) * chunk_size);
+  if (!binary) stream.text = malloc(TEXT_READ_SIZE);
+
+  pthread_t reader;
+  if (pthread_create(&reader, NULL, ReaderThread, &stream)) {
+    printf("Error: pthread_create failed!\n");
+    return false;
+  }
+
+  for (int i = 0;; i ^= 1) {
+    struct Chunk *chunk = &stream.chunks[i];
+    pthread_mutex_lock(&stream.lock);
+    while (!chunk->full && !stream.done) {
+      pthread_cond_wait(&stream.changed, &stream.lock);
+    }
+    bool ready = chunk->full;
+    pthread_mutex_unlock(&stream.lock);
+    if (!ready) break;
+
+    // The reader is filling the other chunk meanwhile.
+    ReduceChunk(chunk, stats);
+
+    pthread_mutex_lock(&stream.lock);
+    chunk->full = false;
+    pthread_cond_broadcast(&stream.changed);
+    pthread_mutex_unlock(&stream.lock);
+  }
+
+  pthread_join(reader, NULL);
+  free(stream.chunks[0].values);
+  free(stream.chunks[1].values);
+  free(stream.text);
+  pthread_mutex_destroy(&stream.lock);
+  pthread_cond_destroy(&stream.changed);
+  return !stream.failed;
+}
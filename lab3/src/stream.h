@@ -0,0 +1,27 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+#define STREAM_DEFAULT_CHUNK (1 << 16)
+
+struct StreamStats {
+  struct MinMax min_max;
+  // Wraps only after about 2^32 values of the largest magnitude.
+  int64_t sum;
+  uint64_t count;
+};
+
+// Reduces every integer read from fd, without ever holding more than two
+// chunks of chunk_size values. A reader thread fills one chunk while the
+// caller reduces the other. Input is either raw native-endian int32 values
+// (binary) or whitespace-separated decimal text. Prints the reason and
+// returns false on a read error or malformed input.
+bool StreamMinMax(int fd, bool binary, size_t chunk_size,
+                  struct StreamStats *stats);
+
+#endif
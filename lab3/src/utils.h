@@ -6,6 +6,13 @@ struct MinMax {
   int max;
 };
 
+// Fills the array with non-negative pseudo-random numbers derived from
+// (seed, index) only, so the result is identical for any thread count.
+// GenerateArray uses one thread per online CPU.
 void GenerateArray(int *array, unsigned int array_size, unsigned int seed);
+void GenerateArrayParallel(int *array, unsigned int array_size,
+                           unsigned int seed, unsigned int threads_num);
+void GenerateArrayRange(int *array, unsigned int begin, unsigned int end,
+                        unsigned int seed);
 
 #endif
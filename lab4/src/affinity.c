@@ -0,0 +1,171 @@
+#define _GNU_SOURCE  // sched_getaffinity, CPU_SET
+
+#include "affinity.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct CpuInfo {
+  int cpu;
+  int node;
+  int package;
+  int core;
+  // Position among the SMT siblings of its core, 0 for the first.
+  int smt;
+  // Position of its core among the cores of its node.
+  int core_rank;
+};
+
+bool ParsePinPolicy(const char *name, enum PinPolicy *policy) {
+  if (strcmp(name, "none") == 0) {
+    *policy = PIN_NONE;
+  } else if (strcmp(name, "compact") == 0) {
+    *policy = PIN_COMPACT;
+  } else if (strcmp(name, "scatter") == 0) {
+    *policy = PIN_SCATTER;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *PinPolicyName(enum PinPolicy policy) {
+  switch (policy) {
+    case PIN_COMPACT:
+      return "compact";
+    case PIN_SCATTER:
+      return "scatter";
+    default:
+      return "none";
+  }
+}
+
+// Reads a single integer from a sysfs file, or returns fallback.
+static int ReadSysfsInt(int cpu, const char *name, int fallback) {
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s",
+           cpu, name);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) return fallback;
+  int value;
+  if (fscanf(file, "%d", &value) != 1) value = fallback;
+  fclose(file);
+  return value;
+}
+
+// The cpuN directory holds a nodeK link on NUMA kernels; without one the
+// machine is treated as a single node.
+static int NodeOfCpu(int cpu) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR *dir = opendir(path);
+  if (dir == NULL) return 0;
+  int node = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (sscanf(entry->d_name, "node%d", &node) == 1) break;
+  }
+  closedir(dir);
+  return node;
+}
+
+static int CompareCompact(const void *a, const void *b) {
+  const struct CpuInfo *x = a, *y = b;
+  if (x->node != y->node) return x->node - y->node;
+  if (x->package != y->package) return x->package - y->package;
+  if (x->core != y->core) return x->core - y->core;
+  return x->cpu - y->cpu;
+}
+
+static int CompareScatter(const void *a, const void *b) {
+  const struct CpuInfo *x = a, *y = b;
+  if (x->smt != y->smt) return x->smt - y->smt;
+  if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+  if (x->node != y->node) return x->node - y->node;
+  return x->cpu - y->cpu;
+}
+
+bool BuildPlacement(struct Placement *placement) {
+  placement->cpus = NULL;
+  placement->cpus_num = 0;
+  placement->nodes_num = 1;
+  if (placement->policy == PIN_NONE) return true;
+
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return false;
+  int count = CPU_COUNT(&allowed);
+  struct CpuInfo *infos = malloc(sizeof(struct CpuInfo) * count);
+  int infos_num = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE && infos_num < count; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    struct CpuInfo *info = &infos[infos_num++];
+    info->cpu = cpu;
+    info->node = NodeOfCpu(cpu);
+    info->package = ReadSysfsInt(cpu, "physical_package_id", 0);
+    info->core = ReadSysfsInt(cpu, "core_id", cpu);
+  }
+
+  // In compact order siblings are adjacent and cores are grouped by node,
+  // so one pass assigns both ranks.
+  qsort(infos, infos_num, sizeof(struct CpuInfo), CompareCompact);
+  int nodes_num = 0;
+  for (int i = 0; i < infos_num; i++) {
+    struct CpuInfo *info = &infos[i];
+    struct CpuInfo *prev = i > 0 ? &infos[i - 1] : NULL;
+    bool new_node = prev == NULL || prev->node != info->node;
+    bool same_core = !new_node && prev->package == info->package &&
+                     prev->core == info->core;
+    if (new_node) nodes_num++;
+    info->smt = same_core ? prev->smt + 1 : 0;
+    info->core_rank = new_node ? 0
+                      : same_core ? prev->core_rank
+                                  : prev->core_rank + 1;
+  }
+  if (placement->policy == PIN_SCATTER) {
+    qsort(infos, infos_num, sizeof(struct CpuInfo), CompareScatter);
+  }
+
+  placement->cpus = malloc(sizeof(int) * infos_num);
+  for (int i = 0; i < infos_num; i++) {
+    placement->cpus[i] = infos[i].cpu;
+  }
+  placement->cpus_num = infos_num;
+  placement->nodes_num = nodes_num;
+  free(infos);
+  return infos_num > 0;
+}
+
+void FreePlacement(struct Placement *placement) {
+  free(placement->cpus);
+  placement->cpus = NULL;
+  placement->cpus_num = 0;
+}
+
+int PlacementCpu(const struct Placement *placement, int worker) {
+  if (placement->cpus_num == 0) return -1;
+  return placement->cpus[worker % placement->cpus_num];
+}
+
+bool PinSelf(int cpu) {
+  if (cpu < 0) return true;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void PrintPlacement(const struct Placement *placement, int workers_num) {
+  printf("Placement: %s over %d node(s)%s", PinPolicyName(placement->policy),
+         placement->nodes_num,
+         placement->first_touch ? ", first-touch" : "");
+  if (placement->cpus_num > 0) {
+    printf(", CPUs");
+    for (int i = 0; i < workers_num; i++) {
+      printf("%s%d", i == 0 ? " " : ",", PlacementCpu(placement, i));
+    }
+  }
+  printf("\n");
+}
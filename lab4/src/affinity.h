@@ -0,0 +1,38 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdbool.h>
+
+// Where workers run. compact fills the SMT siblings and cores of one node
+// before moving to the next; scatter spreads workers over nodes first,
+// then cores, and uses SMT siblings last.
+enum PinPolicy { PIN_NONE, PIN_COMPACT, PIN_SCATTER };
+
+// Worker i runs on cpus[i % cpus_num]. With first_touch, main leaves the
+// array untouched and every worker generates its own segment after
+// pinning itself, so the kernel backs that segment with pages on the
+// worker's node.
+struct Placement {
+  enum PinPolicy policy;
+  bool first_touch;
+  int *cpus;
+  int cpus_num;
+  int nodes_num;
+};
+
+bool ParsePinPolicy(const char *name, enum PinPolicy *policy);
+const char *PinPolicyName(enum PinPolicy policy);
+
+// Orders the CPUs this process may run on according to placement->policy,
+// using the topology in /sys/devices/system. Returns false if the allowed
+// CPU set cannot be read. With PIN_NONE, cpus stays NULL.
+bool BuildPlacement(struct Placement *placement);
+void FreePlacement(struct Placement *placement);
+
+// CPU for the given worker, or -1 when workers are not pinned.
+int PlacementCpu(const struct Placement *placement, int worker);
+// Binds the calling thread (or single-threaded process) to cpu.
+bool PinSelf(int cpu);
+void PrintPlacement(const struct Placement *placement, int workers_num);
+
+#endif
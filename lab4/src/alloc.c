@@ -0,0 +1,187 @@
+#include "alloc.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define DEFAULT_HUGE_PAGE_SIZE (2UL << 20)
+
+bool ParsePageBacking(const char *name, enum PageBacking *backing) {
+  if (strcmp(name, "default") == 0) {
+    *backing = PAGES_DEFAULT;
+  } else if (strcmp(name, "thp") == 0) {
+    *backing = PAGES_THP;
+  } else if (strcmp(name, "hugetlb") == 0) {
+    *backing = PAGES_HUGETLB;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *PageBackingName(enum PageBacking backing) {
+  switch (backing) {
+    case PAGES_THP:
+      return "thp";
+    case PAGES_HUGETLB:
+      return "hugetlb";
+    default:
+      return "default";
+  }
+}
+
+// Size of the pages MAP_HUGETLB hands out, from /proc/meminfo.
+static size_t HugePageSize(void) {
+  FILE *file = fopen("/proc/meminfo", "r");
+  if (file == NULL) return DEFAULT_HUGE_PAGE_SIZE;
+  char line[128];
+  size_t size = DEFAULT_HUGE_PAGE_SIZE;
+  unsigned long kb;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+      size = kb << 10;
+      break;
+    }
+  }
+  fclose(file);
+  return size;
+}
+
+static size_t RoundUp(size_t value, size_t step) {
+  return (value + step - 1) / step * step;
+}
+
+static void Prefault(void *data, size_t bytes) {
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(data, bytes, MADV_POPULATE_WRITE) == 0) return;
+#endif
+  // Older kernels: one write per base page does the same.
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < bytes; offset += page_size) {
+    ((volatile char *)data)[offset] = 0;
+  }
+}
+
+// Over-maps by one huge page and trims both ends, so the array starts on
+// a huge page boundary and khugepaged or the fault path can back it
+// with whole huge pages.
+static bool MapTransparent(size_t bytes, bool populate,
+                           struct ArrayAllocation *allocation) {
+  size_t huge = DEFAULT_HUGE_PAGE_SIZE;
+  size_t rounded = RoundUp(bytes, huge);
+  char *raw = mmap(NULL, rounded + huge, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) return false;
+
+  char *aligned = (char *)RoundUp((uintptr_t)raw, huge);
+  size_t head = aligned - raw;
+  size_t tail = huge - head;
+  if (head > 0) munmap(raw, head);
+  if (tail > 0) munmap(aligned + rounded, tail);
+
+  madvise(aligned, rounded, MADV_HUGEPAGE);
+  if (populate) Prefault(aligned, rounded);
+
+  allocation->data = aligned;
+  allocation->base = aligned;
+  allocation->mapped_bytes = rounded;
+  allocation->obtained = PAGES_THP;
+  return true;
+}
+
+void *AllocateArray(size_t bytes, enum PageBacking backing, bool populate,
+                    struct ArrayAllocation *allocation) {
+  memset(allocation, 0, sizeof(*allocation));
+  allocation->bytes = bytes;
+  allocation->requested = backing;
+  allocation->populated = populate;
+  allocation->huge_bytes = -1;
+
+  if (backing == PAGES_HUGETLB) {
+    size_t rounded = RoundUp(bytes, HugePageSize());
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+    if (populate) flags |= MAP_POPULATE;
+    void *data = mmap(NULL, rounded, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (data != MAP_FAILED) {
+      allocation->data = data;
+      allocation->base = data;
+      allocation->mapped_bytes = rounded;
+      allocation->obtained = PAGES_HUGETLB;
+      return data;
+    }
+    // The pool (vm.nr_hugepages) is empty or too small.
+  }
+
+  if (backing != PAGES_DEFAULT && MapTransparent(bytes, populate, allocation)) {
+    return allocation->data;
+  }
+
+  // mmap is page aligned, which covers the cache line alignment.
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (populate) flags |= MAP_POPULATE;
+  void *data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (data == MAP_FAILED) return NULL;
+  allocation->data = data;
+  allocation->base = data;
+  allocation->mapped_bytes = bytes;
+  allocation->obtained = PAGES_DEFAULT;
+  return data;
+}
+
+void FreeArray(struct ArrayAllocation *allocation) {
+  if (allocation->base != NULL) {
+    munmap(allocation->base, allocation->mapped_bytes);
+  }
+  allocation->data = NULL;
+  allocation->base = NULL;
+}
+
+// Sums AnonHugePages over the /proc/self/smaps entries that overlap the
+// array. Returns -1 if smaps cannot be read.
+static long long HugeBytesIn(const void *data, size_t bytes) {
+  FILE *file = fopen("/proc/self/smaps", "r");
+  if (file == NULL) return -1;
+  uintptr_t begin = (uintptr_t)data, end = begin + bytes;
+  bool inside = false;
+  long long total = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    uintptr_t vma_begin, vma_end;
+    unsigned long kb;
+    // Field names never parse as a hex range, so this only matches the
+    // header line that starts each mapping.
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR, &vma_begin, &vma_end) == 2) {
+      inside = vma_begin < end && vma_end > begin;
+    } else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+      total += (long long)kb << 10;
+    }
+  }
+  fclose(file);
+  return total;
+}
+
+void MeasureAllocation(struct ArrayAllocation *allocation) {
+  if (allocation->obtained == PAGES_HUGETLB) {
+    allocation->huge_bytes = allocation->bytes;
+    return;
+  }
+  long long huge = HugeBytesIn(allocation->data, allocation->bytes);
+  // The tail huge page may extend past the array.
+  if (huge > (long long)allocation->bytes) huge = allocation->bytes;
+  allocation->huge_bytes = huge;
+}
+
+void PrintAllocation(const struct ArrayAllocation *allocation) {
+  printf("Pages: %s requested, %s obtained",
+         PageBackingName(allocation->requested),
+         PageBackingName(allocation->obtained));
+  if (allocation->huge_bytes >= 0 && allocation->bytes > 0) {
+    printf(", %.1f%% in huge pages",
+           100.0 * allocation->huge_bytes / allocation->bytes);
+  }
+  printf("%s\n", allocation->populated ? ", prefaulted" : "");
+}
@@ -0,0 +1,45 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Page backing for the big arrays. default leaves it to the system THP
+// policy; thp asks for transparent huge pages with MADV_HUGEPAGE; hugetlb
+// takes explicit pages from the hugetlbfs pool and falls back to thp when
+// the pool is too small.
+enum PageBacking { PAGES_DEFAULT, PAGES_THP, PAGES_HUGETLB };
+
+struct ArrayAllocation {
+  void *data;
+  size_t bytes;
+  // What munmap needs: the mapping may be rounded up and realigned.
+  void *base;
+  size_t mapped_bytes;
+  enum PageBacking requested;
+  enum PageBacking obtained;
+  bool populated;
+  // Bytes of the array in huge pages as of the last MeasureAllocation,
+  // or -1 if unknown.
+  long long huge_bytes;
+};
+
+bool ParsePageBacking(const char *name, enum PageBacking *backing);
+const char *PageBackingName(enum PageBacking backing);
+
+// Maps bytes of zeroed memory, aligned to at least CACHE_LINE_SIZE (to
+// the huge page size for thp and hugetlb). With populate every page is
+// faulted in before returning, so workers never take the faults;
+// otherwise pages stay untouched until first written. Returns NULL if
+// nothing could be mapped.
+void *AllocateArray(size_t bytes, enum PageBacking backing, bool populate,
+                    struct ArrayAllocation *allocation);
+void FreeArray(struct ArrayAllocation *allocation);
+
+// THP is best effort, so how much of the array really sits in huge pages
+// is only known once it has been touched: call this after the run, before
+// FreeArray, and PrintAllocation reports the result.
+void MeasureAllocation(struct ArrayAllocation *allocation);
+void PrintAllocation(const struct ArrayAllocation *allocation);
+
+#endif
@@ -0,0 +1,508 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <getopt.h>
+
+#include "find_min_max.h"
+#include "sum.h"
+#include "utils.h"
+
+#define MAX_LIST 16
+#define MAX_ROWS 1024
+#define MAX_BASELINE 1024
+// In-process kernels are called in a loop until one sample takes at least
+// this long, so L1-sized arrays are not lost in clock resolution.
+#define MIN_SAMPLE_NS 5000000ULL
+#define DEFAULT_REPEAT 5
+#define DEFAULT_THRESHOLD 10.0
+
+// Sizes span L1 (16 KiB of ints) to well beyond the last-level cache.
+static const unsigned int default_sizes[] = {4096, 65536, 1048576, 16777216,
+                                             67108864};
+static const char *default_modes = "sequential,pipes,files,shm,threads";
+
+struct Row {
+  char bench[16];
+  char mode[16];
+  char impl[16];
+  int workers;
+  unsigned int size;
+  int repeat;
+  double median_ms;
+  double min_ms;
+  double max_ms;
+  // Median absolute deviation from the median.
+  double mad_ms;
+};
+
+struct Settings {
+  unsigned int sizes[MAX_LIST];
+  int sizes_num;
+  int workers[MAX_LIST];
+  int workers_num;
+  char modes[256];
+  int repeat;
+  bool json;
+  const char *baseline;
+  double threshold;
+};
+
+static struct Row rows[MAX_ROWS];
+static int rows_num = 0;
+// Program runs that failed; their rows are left out, so any failure
+// makes the sweep exit nonzero.
+static int failed_runs = 0;
+static volatile int64_t sink;
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double Median(double *values, int count) {
+  qsort(values, count, sizeof(double), CompareDoubles);
+  return count % 2 ? values[count / 2]
+                   : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static void AddRow(const char *bench, const char *mode, const char *impl,
+                   int workers, unsigned int size, double *samples,
+                   int count) {
+  if (rows_num == MAX_ROWS || count == 0)
+    return;
+  struct Row *row = &rows[rows_num++];
+  snprintf(row->bench, sizeof(row->bench), "%s", bench);
+  snprintf(row->mode, sizeof(row->mode), "%s", mode);
+  snprintf(row->impl, sizeof(row->impl), "%s", impl);
+  row->workers = workers;
+  row->size = size;
+  row->repeat = count;
+  row->median_ms = Median(samples, count);
+  row->min_ms = samples[0];
+  row->max_ms = samples[count - 1];
+
+  double deviations[count];
+  for (int i = 0; i < count; i++) {
+    deviations[i] = samples[i] - row->median_ms;
+    if (deviations[i] < 0)
+      deviations[i] = -deviations[i];
+  }
+  row->mad_ms = Median(deviations, count);
+}
+
+static bool HasMode(const struct Settings *settings, const char *mode) {
+  char modes[sizeof(settings->modes)];
+  snprintf(modes, sizeof(modes), "%s", settings->modes);
+  for (char *token = strtok(modes, ","); token; token = strtok(NULL, ",")) {
+    if (strcmp(token, mode) == 0)
+      return true;
+  }
+  return false;
+}
+
+// Milliseconds per kernel call over the whole array.
+static double TimeMinMax(enum MinMaxImpl impl, int *array, unsigned int size) {
+  uint64_t calls = 0, start = NowNs(), elapsed;
+  do {
+    struct MinMax min_max = GetMinMaxWith(impl, array, 0, size);
+    sink += min_max.min ^ min_max.max;
+    calls++;
+    elapsed = NowNs() - start;
+  } while (elapsed < MIN_SAMPLE_NS);
+  return elapsed / 1e6 / calls;
+}
+
+static double TimeSum(enum SumImpl impl, int *array, unsigned int size) {
+  struct SumArgs args = {array, 0, (int)size};
+  uint64_t calls = 0, start = NowNs(), elapsed;
+  do {
+    sink += SumWith(impl, &args);
+    calls++;
+    elapsed = NowNs() - start;
+  } while (elapsed < MIN_SAMPLE_NS);
+  return elapsed / 1e6 / calls;
+}
+
+static void BenchKernels(const struct Settings *settings, unsigned int size) {
+  int *array = aligned_alloc(CACHE_LINE_SIZE,
+                             ((sizeof(int) * size + CACHE_LINE_SIZE - 1) /
+                              CACHE_LINE_SIZE) * CACHE_LINE_SIZE);
+  GenerateArray(array, size, 1);
+  double samples[settings->repeat];
+
+  for (int impl = 0; impl < MIN_MAX_IMPL_COUNT; impl++) {
+    if (!MinMaxImplSupported(impl))
+      continue;
+    TimeMinMax(impl, array, size);
+    for (int i = 0; i < settings->repeat; i++)
+      samples[i] = TimeMinMax(impl, array, size);
+    AddRow("min_max", "sequential", MinMaxImplName(impl), 1, size, samples,
+           settings->repeat);
+  }
+  for (int impl = 0; impl < SUM_IMPL_COUNT; impl++) {
+    if (!SumImplSupported(impl))
+      continue;
+    TimeSum(impl, array, size);
+    for (int i = 0; i < settings->repeat; i++)
+      samples[i] = TimeSum(impl, array, size);
+    AddRow("sum", "sequential", SumImplName(impl), 1, size, samples,
+           settings->repeat);
+  }
+  free(array);
+}
+
+// Runs one of the lab programs and returns the "Elapsed time" it reports,
+// which covers only the reduction, not array generation. Returns a
+// negative value if the run failed.
+static double RunProgram(char *const argv[], char *kernel, size_t kernel_size) {
+  int pipefd[2];
+  if (pipe(pipefd) < 0)
+    return -1;
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    dup2(pipefd[1], STDOUT_FILENO);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    execv(argv[0], argv);
+    perror("execv failed");
+    exit(1);
+  }
+
+  close(pipefd[1]);
+  FILE *output = fdopen(pipefd[0], "r");
+  double elapsed = -1;
+  char line[256];
+  while (fgets(line, sizeof(line), output)) {
+    double value;
+    char name[32];
+    if (sscanf(line, "Elapsed time: %lfms", &value) == 1)
+      elapsed = value;
+    else if (sscanf(line, "Kernel: %31s", name) == 1)
+      snprintf(kernel, kernel_size, "%s", name);
+  }
+  fclose(output);
+
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return -1;
+  return elapsed;
+}
+
+static void BenchProgram(const struct Settings *settings, const char *bench,
+                         const char *mode, int workers, unsigned int size,
+                         char *const argv[]) {
+  double samples[settings->repeat];
+  char kernel[32] = "unknown";
+  int count = 0;
+  for (int i = 0; i < settings->repeat; i++) {
+    double elapsed = RunProgram(argv, kernel, sizeof(kernel));
+    if (elapsed < 0) {
+      fprintf(stderr, "%s failed for %s, %d workers, size %u\n", argv[0], mode,
+              workers, size);
+      failed_runs++;
+      return;
+    }
+    samples[count++] = elapsed;
+  }
+  AddRow(bench, mode, kernel, workers, size, samples, count);
+}
+
+static void BenchModes(const struct Settings *settings, unsigned int size) {
+  static const char *process_modes[] = {"pipes", "files", "shm"};
+  static const char *process_flags[] = {NULL, "--by_files", "--by_shm"};
+  char size_arg[16];
+  snprintf(size_arg, sizeof(size_arg), "%u", size);
+
+  for (int w = 0; w < settings->workers_num; w++) {
+    char workers_arg[16];
+    snprintf(workers_arg, sizeof(workers_arg), "%d", settings->workers[w]);
+
+    for (int m = 0; m < 3; m++) {
+      if (!HasMode(settings, process_modes[m]))
+        continue;
+      char *argv[] = {"./parallel_min_max", "--seed", "1", "--array_size",
+                      size_arg, "--pnum", workers_arg,
+                      (char *)process_flags[m], NULL};
+      BenchProgram(settings, "min_max", process_modes[m], settings->workers[w],
+                   size, argv);
+    }
+    if (HasMode(settings, "threads")) {
+      char *min_max_argv[] = {"./parallel_min_max", "--seed", "1",
+                              "--array_size", size_arg, "--pnum", workers_arg,
+                              "--threads", NULL};
+      BenchProgram(settings, "min_max", "threads", settings->workers[w], size,
+                   min_max_argv);
+      char *sum_argv[] = {"./parallel_sum", "--seed", "1", "--array_size",
+                          size_arg, "--threads_num", workers_arg, NULL};
+      BenchProgram(settings, "sum", "threads", settings->workers[w], size,
+                   sum_argv);
+    }
+  }
+}
+
+static void PrintCsv(FILE *out) {
+  fprintf(out, "bench,mode,impl,workers,size,repeat,median_ms,min_ms,max_ms,"
+               "mad_ms,melems_per_s\n");
+  for (int i = 0; i < rows_num; i++) {
+    const struct Row *row = &rows[i];
+    fprintf(out, "%s,%s,%s,%d,%u,%d,%.6f,%.6f,%.6f,%.6f,%.1f\n", row->bench,
+            row->mode, row->impl, row->workers, row->size, row->repeat,
+            row->median_ms, row->min_ms, row->max_ms, row->mad_ms,
+            row->size / row->median_ms / 1e3);
+  }
+}
+
+static void PrintJson(FILE *out) {
+  fprintf(out, "[\n");
+  for (int i = 0; i < rows_num; i++) {
+    const struct Row *row = &rows[i];
+    fprintf(out,
+            "  {\"bench\": \"%s\", \"mode\": \"%s\", \"impl\": \"%s\", "
+            "\"workers\": %d, \"size\": %u, \"repeat\": %d, "
+            "\"median_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, "
+            "\"mad_ms\": %.6f, \"melems_per_s\": %.1f}%s\n",
+            row->bench, row->mode, row->impl, row->workers, row->size,
+            row->repeat, row->median_ms, row->min_ms, row->max_ms,
+            row->mad_ms, row->size / row->median_ms / 1e3,
+            i + 1 < rows_num ? "," : "");
+  }
+  fprintf(out, "]\n");
+}
+
+// Compares medians with a CSV written by an earlier run. A row counts as
+// a regression if it got slower by more than threshold percent and by
+// more than its own spread (3 MADs), so noisy rows do not fire.
+// The rows of this run and of the baseline must match one to one, so a
+// baseline in another format, for other sizes, workers or modes, or
+// truncated cannot pass by comparing nothing, and a row this run lost
+// (say, to a failed program) cannot pass by being skipped.
+// Returns the number of regressions, or -1 if the baseline is unreadable
+// or does not cover this run.
+static int CompareBaseline(const char *path, double threshold) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    perror("Failed to open baseline");
+    return -1;
+  }
+
+  bool compared[MAX_ROWS] = {false};
+  int regressions = 0, matched = 0, missing = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    struct Row base;
+    if (sscanf(line, "%15[^,],%15[^,],%15[^,],%d,%u,%d,%lf,%lf,%lf,%lf",
+               base.bench, base.mode, base.impl, &base.workers, &base.size,
+               &base.repeat, &base.median_ms, &base.min_ms, &base.max_ms,
+               &base.mad_ms) != 10)
+      continue;
+
+    int i = 0;
+    for (; i < rows_num; i++) {
+      const struct Row *row = &rows[i];
+      if (strcmp(row->bench, base.bench) || strcmp(row->mode, base.mode) ||
+          strcmp(row->impl, base.impl) || row->workers != base.workers ||
+          row->size != base.size)
+        continue;
+
+      if (!compared[i])
+        matched++;
+      compared[i] = true;
+      double change = (row->median_ms / base.median_ms - 1) * 100;
+      double noise = 3 * (row->mad_ms > base.mad_ms ? row->mad_ms
+                                                     : base.mad_ms);
+      bool slower = change > threshold &&
+                    row->median_ms - base.median_ms > noise;
+      if (slower)
+        regressions++;
+      if (slower || change < -threshold)
+        fprintf(stderr, "%s %s/%s/%s workers=%d size=%u: %.6f -> %.6f ms "
+                        "(%+.1f%%)\n",
+                slower ? "REGRESSION" : "improved", row->bench, row->mode,
+                row->impl, row->workers, row->size, base.median_ms,
+                row->median_ms, change);
+      break;
+    }
+    if (i == rows_num) {
+      fprintf(stderr, "This run has no row for %s/%s/%s workers=%d size=%u\n",
+              base.bench, base.mode, base.impl, base.workers, base.size);
+      missing++;
+    }
+  }
+  fclose(file);
+
+  for (int i = 0; i < rows_num; i++) {
+    if (!compared[i])
+      fprintf(stderr, "Baseline has no row for %s/%s/%s workers=%d size=%u\n",
+              rows[i].bench, rows[i].mode, rows[i].impl, rows[i].workers,
+              rows[i].size);
+  }
+  fprintf(stderr, "Baseline: %d of %d rows compared, %d regressions over "
+                  "%.1f%%\n",
+          matched, rows_num, regressions, threshold);
+  if (matched == 0 || matched < rows_num || missing > 0) {
+    fprintf(stderr, "Baseline %s does not match this run (it must be the "
+                    "CSV of a run with the same sizes, workers and modes)\n",
+            path);
+    return -1;
+  }
+  return regressions;
+}
+
+static int ParseList(const char *text, unsigned int *values) {
+  int count = 0;
+  char copy[256];
+  snprintf(copy, sizeof(copy), "%s", text);
+  for (char *token = strtok(copy, ","); token && count < MAX_LIST;
+       token = strtok(NULL, ",")) {
+    long value = atol(token);
+    if (value <= 0)
+      return -1;
+    values[count++] = (unsigned int)value;
+  }
+  return count;
+}
+
+int main(int argc, char **argv) {
+  struct Settings settings;
+  memset(&settings, 0, sizeof(settings));
+  settings.sizes_num = sizeof(default_sizes) / sizeof(default_sizes[0]);
+  memcpy(settings.sizes, default_sizes, sizeof(default_sizes));
+  snprintf(settings.modes, sizeof(settings.modes), "%s", default_modes);
+  settings.repeat = DEFAULT_REPEAT;
+  settings.threshold = DEFAULT_THRESHOLD;
+
+  // Default worker counts: 1, 2, 4, ... up to the number of CPUs.
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int w = 1; settings.workers_num < MAX_LIST; w *= 2) {
+    if (w >= cpus) {
+      settings.workers[settings.workers_num++] = cpus > 0 ? (int)cpus : 1;
+      break;
+    }
+    settings.workers[settings.workers_num++] = w;
+  }
+
+  while (true) {
+    static struct option options[] = {{"sizes", required_argument, 0, 0},
+                                      {"workers", required_argument, 0, 0},
+                                      {"modes", required_argument, 0, 0},
+                                      {"repeat", required_argument, 0, 0},
+                                      {"json", no_argument, 0, 0},
+                                      {"baseline", required_argument, 0, 0},
+                                      {"threshold", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1) break;
+
+    switch (c) {
+      case 0:
+        switch (option_index) {
+          case 0:
+            settings.sizes_num = ParseList(optarg, settings.sizes);
+            if (settings.sizes_num <= 0) {
+              printf("sizes must be a list of positive numbers\n");
+              return 1;
+            }
+            break;
+          case 1: {
+            unsigned int workers[MAX_LIST];
+            settings.workers_num = ParseList(optarg, workers);
+            if (settings.workers_num <= 0) {
+              printf("workers must be a list of positive numbers\n");
+              return 1;
+            }
+            for (int i = 0; i < settings.workers_num; i++)
+              settings.workers[i] = (int)workers[i];
+            break;
+          }
+          case 2:
+            snprintf(settings.modes, sizeof(settings.modes), "%s", optarg);
+            break;
+          case 3:
+            settings.repeat = atoi(optarg);
+            if (settings.repeat <= 0) {
+              printf("repeat must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 4:
+            settings.json = true;
+            break;
+          case 5:
+            settings.baseline = optarg;
+            break;
+          case 6:
+            settings.threshold = atof(optarg);
+            if (settings.threshold <= 0) {
+              printf("threshold must be a positive number\n");
+              return 1;
+            }
+            break;
+          default:
+            printf("Index %d is out of options\n", option_index);
+        }
+        break;
+
+      case '?':
+        break;
+
+      default:
+        printf("getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  if (optind < argc) {
+    printf("Usage: %s [--sizes 4096,65536,...] [--workers 1,2,4] "
+           "[--modes %s] [--repeat %d] [--json] [--baseline old.csv "
+           "[--threshold %.0f]]\n",
+           argv[0], default_modes, DEFAULT_REPEAT, DEFAULT_THRESHOLD);
+    return 1;
+  }
+
+  for (int i = 0; i < settings.sizes_num; i++) {
+    if (HasMode(&settings, "sequential"))
+      BenchKernels(&settings, settings.sizes[i]);
+    BenchModes(&settings, settings.sizes[i]);
+  }
+
+  if (settings.json)
+    PrintJson(stdout);
+  else
+    PrintCsv(stdout);
+
+  int status = 0;
+  if (settings.baseline) {
+    int regressions = CompareBaseline(settings.baseline, settings.threshold);
+    if (regressions != 0)
+      status = 2;
+  }
+  if (failed_runs > 0) {
+    fprintf(stderr, "%d program runs failed\n", failed_runs);
+    if (status == 0)
+      status = 1;
+  }
+  return status;
+}
@@ -1,8 +1,19 @@
 #include "find_min_max.h"
 
 #include <limits.h>
+#include <stdint.h>
 
-struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
+#include <immintrin.h>
+
+// Elements per GetArrayStats block: 16 KiB, so the second read of a block
+// hits L1.
+#define STATS_BLOCK_SIZE 4096
+
+typedef struct MinMax (*MinMaxKernel)(int *array, unsigned int begin,
+                                      unsigned int end);
+
+static struct MinMax GetMinMaxScalar(int *array, unsigned int begin,
+                                     unsigned int end) {
   struct MinMax min_max;
   min_max.min = INT_MAX;
   min_max.max = INT_MIN;
@@ -15,6 +26,333 @@ struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
       min_max.max = array[i];
     }
   }
-  
+
+  return min_max;
+}
+
+// Merges the tail that did not fill a whole vector iteration.
+static struct MinMax FinishScalar(struct MinMax min_max, int *array,
+                                  unsigned int begin, unsigned int end) {
+  struct MinMax tail = GetMinMaxScalar(array, begin, end);
+  if (tail.min < min_max.min) min_max.min = tail.min;
+  if (tail.max > min_max.max) min_max.max = tail.max;
+  return min_max;
+}
+
+__attribute__((target("sse4.1")))
+static struct MinMax GetMinMaxSSE41(int *array, unsigned int begin,
+                                    unsigned int end) {
+  __m128i min0 = _mm_set1_epi32(INT_MAX), max0 = _mm_set1_epi32(INT_MIN);
+  __m128i min1 = min0, min2 = min0, min3 = min0;
+  __m128i max1 = max0, max2 = max0, max3 = max0;
+
+  unsigned int i = begin;
+  for (; i + 16 <= end; i += 16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(array + i));
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(array + i + 4));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(array + i + 8));
+    __m128i v3 = _mm_loadu_si128((const __m128i *)(array + i + 12));
+    min0 = _mm_min_epi32(min0, v0);
+    min1 = _mm_min_epi32(min1, v1);
+    min2 = _mm_min_epi32(min2, v2);
+    min3 = _mm_min_epi32(min3, v3);
+    max0 = _mm_max_epi32(max0, v0);
+    max1 = _mm_max_epi32(max1, v1);
+    max2 = _mm_max_epi32(max2, v2);
+    max3 = _mm_max_epi32(max3, v3);
+  }
+
+  __m128i min = _mm_min_epi32(_mm_min_epi32(min0, min1), _mm_min_epi32(min2, min3));
+  __m128i max = _mm_max_epi32(_mm_max_epi32(max0, max1), _mm_max_epi32(max2, max3));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(1, 0, 3, 2)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  struct MinMax min_max;
+  min_max.min = _mm_cvtsi128_si32(min);
+  min_max.max = _mm_cvtsi128_si32(max);
+  return FinishScalar(min_max, array, i, end);
+}
+
+__attribute__((target("avx2")))
+static struct MinMax GetMinMaxAVX2(int *array, unsigned int begin,
+                                   unsigned int end) {
+  __m256i min0 = _mm256_set1_epi32(INT_MAX), max0 = _mm256_set1_epi32(INT_MIN);
+  __m256i min1 = min0, min2 = min0, min3 = min0;
+  __m256i max1 = max0, max2 = max0, max3 = max0;
+
+  unsigned int i = begin;
+  for (; i + 32 <= end; i += 32) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(array + i));
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(array + i + 8));
+    __m256i v2 = _mm256_loadu_si256((const __m256i *)(array + i + 16));
+    __m256i v3 = _mm256_loadu_si256((const __m256i *)(array + i + 24));
+    min0 = _mm256_min_epi32(min0, v0);
+    min1 = _mm256_min_epi32(min1, v1);
+    min2 = _mm256_min_epi32(min2, v2);
+    min3 = _mm256_min_epi32(min3, v3);
+    max0 = _mm256_max_epi32(max0, v0);
+    max1 = _mm256_max_epi32(max1, v1);
+    max2 = _mm256_max_epi32(max2, v2);
+    max3 = _mm256_max_epi32(max3, v3);
+  }
+
+  __m256i min256 = _mm256_min_epi32(_mm256_min_epi32(min0, min1),
+                                    _mm256_min_epi32(min2, min3));
+  __m256i max256 = _mm256_max_epi32(_mm256_max_epi32(max0, max1),
+                                    _mm256_max_epi32(max2, max3));
+  __m128i min = _mm_min_epi32(_mm256_castsi256_si128(min256),
+                              _mm256_extracti128_si256(min256, 1));
+  __m128i max = _mm_max_epi32(_mm256_castsi256_si128(max256),
+                              _mm256_extracti128_si256(max256, 1));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+  min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(1, 0, 3, 2)));
+  max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  struct MinMax min_max;
+  min_max.min = _mm_cvtsi128_si32(min);
+  min_max.max = _mm_cvtsi128_si32(max);
+  return FinishScalar(min_max, array, i, end);
+}
+
+__attribute__((target("avx512f")))
+static struct MinMax GetMinMaxAVX512(int *array, unsigned int begin,
+                                     unsigned int end) {
+  __m512i min0 = _mm512_set1_epi32(INT_MAX), max0 = _mm512_set1_epi32(INT_MIN);
+  __m512i min1 = min0, min2 = min0, min3 = min0;
+  __m512i max1 = max0, max2 = max0, max3 = max0;
+
+  unsigned int i = begin;
+  for (; i + 64 <= end; i += 64) {
+    __m512i v0 = _mm512_loadu_si512(array + i);
+    __m512i v1 = _mm512_loadu_si512(array + i + 16);
+    __m512i v2 = _mm512_loadu_si512(array + i + 32);
+    __m512i v3 = _mm512_loadu_si512(array + i + 48);
+    min0 = _mm512_min_epi32(min0, v0);
+    min1 = _mm512_min_epi32(min1, v1);
+    min2 = _mm512_min_epi32(min2, v2);
+    min3 = _mm512_min_epi32(min3, v3);
+    max0 = _mm512_max_epi32(max0, v0);
+    max1 = _mm512_max_epi32(max1, v1);
+    max2 = _mm512_max_epi32(max2, v2);
+    max3 = _mm512_max_epi32(max3, v3);
+  }
+
+  __m512i min = _mm512_min_epi32(_mm512_min_epi32(min0, min1),
+                                 _mm512_min_epi32(min2, min3));
+  __m512i max = _mm512_max_epi32(_mm512_max_epi32(max0, max1),
+                                 _mm512_max_epi32(max2, max3));
+
+  struct MinMax min_max;
+  min_max.min = _mm512_reduce_min_epi32(min);
+  min_max.max = _mm512_reduce_max_epi32(max);
+  return FinishScalar(min_max, array, i, end);
+}
+
+static const MinMaxKernel kernels[MIN_MAX_IMPL_COUNT] = {
+    [MIN_MAX_SCALAR] = GetMinMaxScalar,
+    [MIN_MAX_SSE41] = GetMinMaxSSE41,
+    [MIN_MAX_AVX2] = GetMinMaxAVX2,
+    [MIN_MAX_AVX512] = GetMinMaxAVX512,
+};
+
+static const char *kernel_names[MIN_MAX_IMPL_COUNT] = {
+    [MIN_MAX_SCALAR] = "scalar",
+    [MIN_MAX_SSE41] = "sse4.1",
+    [MIN_MAX_AVX2] = "avx2",
+    [MIN_MAX_AVX512] = "avx512",
+};
+
+static enum MinMaxImpl selected_impl = MIN_MAX_SCALAR;
+
+// Runs once before main, so forked children and threads all see the final
+// choice without any synchronization.
+__attribute__((constructor))
+static void SelectMinMaxImpl(void) {
+  for (int impl = MIN_MAX_IMPL_COUNT - 1; impl > MIN_MAX_SCALAR; impl--) {
+    if (MinMaxImplSupported(impl)) {
+      selected_impl = impl;
+      return;
+    }
+  }
+}
+
+bool MinMaxImplSupported(enum MinMaxImpl impl) {
+  __builtin_cpu_init();
+  switch (impl) {
+    case MIN_MAX_SCALAR:
+      return true;
+    case MIN_MAX_SSE41:
+      return __builtin_cpu_supports("sse4.1");
+    case MIN_MAX_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case MIN_MAX_AVX512:
+      return __builtin_cpu_supports("avx512f");
+    default:
+      return false;
+  }
+}
+
+enum MinMaxImpl GetMinMaxImpl(void) { return selected_impl; }
+
+const char *MinMaxImplName(enum MinMaxImpl impl) {
+  if (impl < 0 || impl >= MIN_MAX_IMPL_COUNT) return "unknown";
+  return kernel_names[impl];
+}
+
+struct MinMax GetMinMaxWith(enum MinMaxImpl impl, int *array,
+                            unsigned int begin, unsigned int end) {
+  return kernels[impl](array, begin, end);
+}
+
+struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end) {
+  return kernels[selected_impl](array, begin, end);
+}
+
+// Sum of a block and sum of squares of (x - shift), in one pass. See
+// GetArrayStats for how they become m2.
+static void ShiftedSumsScalar(const int *array, unsigned int begin,
+                              unsigned int end, int shift, int64_t *sum,
+                              double *squares) {
+  int64_t total = 0;
+  double squares0 = 0, squares1 = 0;
+  unsigned int i = begin;
+  for (; i + 2 <= end; i += 2) {
+    total += (int64_t)array[i] + array[i + 1];
+    double d0 = (double)array[i] - shift, d1 = (double)array[i + 1] - shift;
+    squares0 += d0 * d0;
+    squares1 += d1 * d1;
+  }
+  if (i < end) {
+    total += array[i];
+    double d = (double)array[i] - shift;
+    squares0 += d * d;
+  }
+  *sum = total;
+  *squares = squares0 + squares1;
+}
+
+__attribute__((target("avx2,fma")))
+static void ShiftedSumsAVX2(const int *array, unsigned int begin,
+                            unsigned int end, int shift, int64_t *sum,
+                            double *squares) {
+  __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0;
+  __m256d shift4 = _mm256_set1_pd(shift);
+  __m256d squares0 = _mm256_setzero_pd(), squares1 = squares0;
+  unsigned int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(array + i));
+    __m128i hi = _mm_loadu_si128((const __m128i *)(array + i + 4));
+    sum0 = _mm256_add_epi64(sum0, _mm256_cvtepi32_epi64(lo));
+    sum1 = _mm256_add_epi64(sum1, _mm256_cvtepi32_epi64(hi));
+    __m256d d0 = _mm256_sub_pd(_mm256_cvtepi32_pd(lo), shift4);
+    __m256d d1 = _mm256_sub_pd(_mm256_cvtepi32_pd(hi), shift4);
+    squares0 = _mm256_fmadd_pd(d0, d0, squares0);
+    squares1 = _mm256_fmadd_pd(d1, d1, squares1);
+  }
+  int64_t sum_lanes[4];
+  double square_lanes[4];
+  _mm256_storeu_si256((__m256i *)sum_lanes, _mm256_add_epi64(sum0, sum1));
+  _mm256_storeu_pd(square_lanes, _mm256_add_pd(squares0, squares1));
+  ShiftedSumsScalar(array, i, end, shift, sum, squares);
+  *sum += sum_lanes[0] + sum_lanes[1] + sum_lanes[2] + sum_lanes[3];
+  *squares += square_lanes[0] + square_lanes[1] + square_lanes[2] +
+              square_lanes[3];
+}
+
+static unsigned int FirstIndexOf(const int *array, unsigned int begin,
+                                 unsigned int end, int value) {
+  unsigned int i = begin;
+  while (i < end && array[i] != value) i++;
+  return i;
+}
+
+void MergeArrayStats(struct ArrayStats *into, const struct ArrayStats *other) {
+  if (other->count == 0) return;
+  if (into->count == 0) {
+    *into = *other;
+    return;
+  }
+  if (other->min_max.min < into->min_max.min ||
+      (other->min_max.min == into->min_max.min &&
+       other->argmin < into->argmin)) {
+    into->min_max.min = other->min_max.min;
+    into->argmin = other->argmin;
+  }
+  if (other->min_max.max > into->min_max.max ||
+      (other->min_max.max == into->min_max.max &&
+       other->argmax < into->argmax)) {
+    into->min_max.max = other->min_max.max;
+    into->argmax = other->argmax;
+  }
+  double count_a = into->count, count_b = other->count;
+  double delta = ArrayStatsMean(other) - ArrayStatsMean(into);
+  into->m2 += other->m2 + delta * delta * count_a * count_b /
+                               (count_a + count_b);
+  into->count += other->count;
+  into->sum += other->sum;
+}
+
+double ArrayStatsMean(const struct ArrayStats *stats) {
+  return stats->count > 0 ? (double)stats->sum / stats->count : 0.0;
+}
+
+double ArrayStatsVariance(const struct ArrayStats *stats) {
+  return stats->count > 0 ? stats->m2 / stats->count : 0.0;
+}
+
+struct ArrayStats GetArrayStats(int *array, unsigned int begin,
+                                unsigned int end) {
+  struct ArrayStats stats = {{INT_MAX, INT_MIN}, 0, 0, 0, 0, 0.0};
+  bool use_avx2 = selected_impl >= MIN_MAX_AVX2 &&
+                  __builtin_cpu_supports("fma");
+  for (unsigned int block_begin = begin; block_begin < end;
+       block_begin += STATS_BLOCK_SIZE) {
+    unsigned int block_end = end - block_begin > STATS_BLOCK_SIZE
+                                 ? block_begin + STATS_BLOCK_SIZE
+                                 : end;
+    struct ArrayStats block;
+    block.min_max = GetMinMax(array, block_begin, block_end);
+    block.count = block_end - block_begin;
+    // Blocks arrive in index order, so a block only needs its own
+    // position when it strictly beats what came before.
+    bool first = stats.count == 0;
+    block.argmin = first || block.min_max.min < stats.min_max.min
+                       ? FirstIndexOf(array, block_begin, block_end,
+                                      block.min_max.min)
+                       : UINT_MAX;
+    block.argmax = first || block.min_max.max > stats.min_max.max
+                       ? FirstIndexOf(array, block_begin, block_end,
+                                      block.min_max.max)
+                       : UINT_MAX;
+    // m2 = sum (x - shift)^2 - (sum (x - shift))^2 / n. With shift at the
+    // midpoint of the block's range the correction cannot cancel badly:
+    // it is at most n * range^2 / 4, while m2 is at least range^2 / 2.
+    int shift = block.min_max.min +
+                (int)(((int64_t)block.min_max.max - block.min_max.min) / 2);
+    double squares;
+    if (use_avx2) {
+      ShiftedSumsAVX2(array, block_begin, block_end, shift, &block.sum,
+                      &squares);
+    } else {
+      ShiftedSumsScalar(array, block_begin, block_end, shift, &block.sum,
+                        &squares);
+    }
+    double shifted =
+        (double)(block.sum - (int64_t)shift * (int64_t)block.count);
+    block.m2 = squares - shifted * shifted / block.count;
+    MergeArrayStats(&stats, &block);
+  }
+  return stats;
+}
+
+struct MinMax64 GetMinMax64(const int64_t *array, size_t begin, size_t end) {
+  struct MinMax64 min_max = {INT64_MAX, INT64_MIN};
+  for (size_t i = begin; i < end; i++) {
+    if (array[i] < min_max.min) min_max.min = array[i];
+    if (array[i] > min_max.max) min_max.max = array[i];
+  }
   return min_max;
 }
@@ -1,8 +1,62 @@
 #ifndef FIND_MIN_MAX_H
 #define FIND_MIN_MAX_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "utils.h"
 
+// GetMinMax kernels, from slowest to fastest. The fastest one the CPU
+// supports is picked once at startup.
+enum MinMaxImpl {
+  MIN_MAX_SCALAR,
+  MIN_MAX_SSE41,
+  MIN_MAX_AVX2,
+  MIN_MAX_AVX512,
+  MIN_MAX_IMPL_COUNT
+};
+
 struct MinMax GetMinMax(int *array, unsigned int begin, unsigned int end);
 
+// Runs a specific kernel; impl must be supported by the CPU.
+struct MinMax GetMinMaxWith(enum MinMaxImpl impl, int *array,
+                            unsigned int begin, unsigned int end);
+
+bool MinMaxImplSupported(enum MinMaxImpl impl);
+enum MinMaxImpl GetMinMaxImpl(void);
+const char *MinMaxImplName(enum MinMaxImpl impl);
+
+struct MinMax64 {
+  int64_t min;
+  int64_t max;
+};
+
+// Everything a single pass over an array produces. min and max keep the
+// first index they occur at; m2 is the sum of squared deviations from the
+// mean, so partial results from any split merge exactly (Chan et al.).
+struct ArrayStats {
+  struct MinMax min_max;
+  unsigned int argmin;
+  unsigned int argmax;
+  uint64_t count;
+  int64_t sum;
+  double m2;
+};
+
+// Streams [begin, end) from memory once: each block is reduced to min and
+// max with the selected kernel, then summed and squared while it is still
+// in L1.
+struct ArrayStats GetArrayStats(int *array, unsigned int begin,
+                                unsigned int end);
+// Folds other into into; ties on min or max keep the lower index.
+void MergeArrayStats(struct ArrayStats *into, const struct ArrayStats *other);
+double ArrayStatsMean(const struct ArrayStats *stats);
+// Population variance.
+double ArrayStatsVariance(const struct ArrayStats *stats);
+
+// int64 arrays only come from mapped --input files, which are read at
+// page-cache or storage speed, so a plain loop keeps up.
+struct MinMax64 GetMinMax64(const int64_t *array, size_t begin, size_t end);
+
 #endif
@@ -0,0 +1,94 @@
+#include "input.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool ParseElementType(const char *name, enum ElementType *type) {
+  if (strcmp(name, "int32") == 0) {
+    *type = ELEMENT_INT32;
+  } else if (strcmp(name, "int64") == 0) {
+    *type = ELEMENT_INT64;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+size_t ElementSize(enum ElementType type) {
+  return type == ELEMENT_INT64 ? sizeof(int64_t) : sizeof(int32_t);
+}
+
+bool MapInput(const char *path, enum ElementType type,
+              struct MappedInput *input) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  // Mapping is only zero-copy when the file is already in host order.
+  (void)type;
+  (void)input;
+  printf("%s: little-endian input needs a little-endian host\n", path);
+  return false;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror(path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+
+  size_t element_size = ElementSize(type);
+  size_t bytes = st.st_size;
+  if (bytes == 0 || bytes % element_size != 0) {
+    printf("%s: size %zu is not a positive multiple of %zu bytes\n", path,
+           bytes, element_size);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file referenced on its own.
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror(path);
+    return false;
+  }
+  // Every worker scans its range front to back: read ahead aggressively
+  // and let the kernel drop pages behind the scan.
+  madvise(data, bytes, MADV_SEQUENTIAL);
+
+  input->data = data;
+  input->bytes = bytes;
+  input->count = bytes / element_size;
+  input->type = type;
+  return true;
+#endif
+}
+
+void UnmapInput(struct MappedInput *input) {
+  if (input->data != NULL) {
+    munmap((void *)input->data, input->bytes);
+  }
+  input->data = NULL;
+  input->bytes = 0;
+  input->count = 0;
+}
+
+void PrefetchInput(const struct MappedInput *input, size_t begin, size_t end) {
+  if (input == NULL || input->data == NULL || begin >= end) return;
+  size_t element_size = ElementSize(input->type);
+  uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t first = (uintptr_t)input->data + begin * element_size;
+  uintptr_t last = (uintptr_t)input->data + end * element_size;
+  // madvise wants a page-aligned start.
+  first &= ~(page_size - 1);
+  madvise((void *)first, last - first, MADV_WILLNEED);
+}
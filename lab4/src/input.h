@@ -0,0 +1,32 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum ElementType { ELEMENT_INT32, ELEMENT_INT64 };
+
+// A raw little-endian file of int32 or int64 values, mapped read-only.
+// Workers index data directly, and forked children inherit the mapping,
+// so the file is never copied onto the heap.
+struct MappedInput {
+  const void *data;
+  size_t bytes;
+  size_t count;
+  enum ElementType type;
+};
+
+bool ParseElementType(const char *name, enum ElementType *type);
+size_t ElementSize(enum ElementType type);
+
+// Prints the reason and returns false if the file cannot be mapped or its
+// size is not a whole number of elements.
+bool MapInput(const char *path, enum ElementType type,
+              struct MappedInput *input);
+void UnmapInput(struct MappedInput *input);
+
+// Starts asynchronous read-ahead of elements [begin, end), so a worker's
+// segment streams in while it works through the start of it.
+void PrefetchInput(const struct MappedInput *input, size_t begin, size_t end);
+
+#endif
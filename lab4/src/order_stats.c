@@ -0,0 +1,217 @@
+#include "order_stats.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void TopKInit(struct TopK *top, int k, bool largest) {
+  top->keys = malloc(sizeof(int) * (k > 0 ? k : 1));
+  top->size = 0;
+  top->capacity = k;
+  top->largest = largest;
+}
+
+void TopKFree(struct TopK *top) {
+  free(top->keys);
+  top->keys = NULL;
+}
+
+// keys is a max-heap, so the root is the worst value kept.
+static void SiftDown(int *keys, int size, int i) {
+  int key = keys[i];
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= size) break;
+    if (child + 1 < size && keys[child + 1] > keys[child]) child++;
+    if (keys[child] <= key) break;
+    keys[i] = keys[child];
+    i = child;
+  }
+  keys[i] = key;
+}
+
+static void PushKey(struct TopK *top, int key) {
+  if (top->size < top->capacity) {
+    int i = top->size++;
+    while (i > 0 && top->keys[(i - 1) / 2] < key) {
+      top->keys[i] = top->keys[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    top->keys[i] = key;
+  } else if (top->capacity > 0 && key < top->keys[0]) {
+    top->keys[0] = key;
+    SiftDown(top->keys, top->size, 0);
+  }
+}
+
+void TopKScan(struct TopK *top, const int *array, unsigned int begin,
+              unsigned int end) {
+  // ~x flips the order, so "largest" becomes "smallest key".
+  int flip = top->largest ? -1 : 0;
+  unsigned int i = begin;
+  for (; i < end && top->size < top->capacity; i++) {
+    PushKey(top, array[i] ^ flip);
+  }
+  if (top->capacity == 0) return;
+  for (; i < end; i++) {
+    int key = array[i] ^ flip;
+    if (key < top->keys[0]) {
+      top->keys[0] = key;
+      SiftDown(top->keys, top->size, 0);
+    }
+  }
+}
+
+void TopKMerge(struct TopK *into, const struct TopK *other) {
+  for (int i = 0; i < other->size; i++) {
+    PushKey(into, other->keys[i]);
+  }
+}
+
+int TopKSorted(const struct TopK *top, int *out) {
+  int flip = top->largest ? -1 : 0;
+  int *keys = malloc(sizeof(int) * (top->size > 0 ? top->size : 1));
+  memcpy(keys, top->keys, sizeof(int) * top->size);
+  // Heap sort in place: repeatedly move the root behind the heap.
+  for (int size = top->size; size > 1; size--) {
+    int worst = keys[0];
+    keys[0] = keys[size - 1];
+    keys[size - 1] = worst;
+    SiftDown(keys, size - 1, 0);
+  }
+  for (int i = 0; i < top->size; i++) {
+    out[i] = keys[i] ^ flip;
+  }
+  free(keys);
+  return top->size;
+}
+
+// Flipping the sign bit makes unsigned order match int order.
+static uint32_t RadixKey(int value) { return (uint32_t)value ^ 0x80000000u; }
+
+void RadixCountHigh(const int *array, unsigned int begin, unsigned int end,
+                    uint32_t *counts) {
+  for (unsigned int i = begin; i < end; i++) {
+    counts[RadixKey(array[i]) >> 16]++;
+  }
+}
+
+void RadixCountLow(const int *array, unsigned int begin, unsigned int end,
+                   const int *targets, uint32_t *counts) {
+  for (unsigned int i = begin; i < end; i++) {
+    uint32_t key = RadixKey(array[i]);
+    int target = targets[key >> 16];
+    if (target >= 0) {
+      counts[(size_t)target * RADIX_BUCKETS + (key & 0xFFFF)]++;
+    }
+  }
+}
+
+int RadixFindBucket(const uint64_t *counts, uint64_t *rank) {
+  for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+    if (*rank < counts[bucket]) return bucket;
+    *rank -= counts[bucket];
+  }
+  return RADIX_BUCKETS - 1;
+}
+
+int RadixValue(int high, int low) {
+  return (int)(((uint32_t)high << 16 | (uint32_t)low) ^ 0x80000000u);
+}
+
+uint64_t QuantileRank(double q, uint64_t count) {
+  if (count == 0) return 0;
+  double rank = ceil(q * count) - 1;
+  if (rank < 0) return 0;
+  if (rank > count - 1) return count - 1;
+  return (uint64_t)rank;
+}
+
+// exponent + (mantissa - 1) for magnitude = mantissa * 2^exponent: equal
+// to log2 at powers of two and linear in between. Its slope is never
+// below that of the natural log, so buckets of width ln(gamma) in it
+// still span at most a factor gamma.
+static double ApproxLog2(double magnitude) {
+  uint64_t bits;
+  memcpy(&bits, &magnitude, sizeof(bits));
+  int exponent = (int)(bits >> 52) - 1023;
+  double fraction = (double)(bits & ((1ULL << 52) - 1)) / (double)(1ULL << 52);
+  return exponent + fraction;
+}
+
+static double ApproxExp2(double log) {
+  double exponent = floor(log);
+  return ldexp(1.0 + (log - exponent), (int)exponent);
+}
+
+void SketchInit(struct QuantileSketch *sketch, double alpha) {
+  double gamma = (1 + alpha) / (1 - alpha);
+  sketch->alpha = alpha;
+  sketch->multiplier = 1 / log(gamma);
+  // Magnitudes of ints run from 1 to 2^31.
+  sketch->buckets_num = (int)(31 * sketch->multiplier) + 2;
+  sketch->positive = calloc(sketch->buckets_num, sizeof(uint64_t));
+  sketch->negative = calloc(sketch->buckets_num, sizeof(uint64_t));
+  sketch->zero = 0;
+  sketch->count = 0;
+}
+
+void SketchFree(struct QuantileSketch *sketch) {
+  free(sketch->positive);
+  free(sketch->negative);
+  sketch->positive = NULL;
+  sketch->negative = NULL;
+}
+
+void SketchAddRange(struct QuantileSketch *sketch, const int *array,
+                    unsigned int begin, unsigned int end) {
+  double multiplier = sketch->multiplier;
+  for (unsigned int i = begin; i < end; i++) {
+    int value = array[i];
+    if (value > 0) {
+      sketch->positive[(int)(ApproxLog2(value) * multiplier)]++;
+    } else if (value < 0) {
+      sketch->negative[(int)(ApproxLog2(-(double)value) * multiplier)]++;
+    } else {
+      sketch->zero++;
+    }
+  }
+  sketch->count += end - begin;
+}
+
+void SketchMerge(struct QuantileSketch *into,
+                 const struct QuantileSketch *other) {
+  for (int i = 0; i < into->buckets_num; i++) {
+    into->positive[i] += other->positive[i];
+    into->negative[i] += other->negative[i];
+  }
+  into->zero += other->zero;
+  into->count += other->count;
+}
+
+// The harmonic mean of a bucket's bounds is within alpha of both.
+static double BucketValue(const struct QuantileSketch *sketch, int bucket) {
+  double low = ApproxExp2(bucket / sketch->multiplier);
+  double high = ApproxExp2((bucket + 1) / sketch->multiplier);
+  return 2 * low * high / (low + high);
+}
+
+double SketchQuantile(const struct QuantileSketch *sketch, double q) {
+  uint64_t rank = QuantileRank(q, sketch->count);
+  // Ascending order: most negative first, then zero, then positives.
+  for (int i = sketch->buckets_num - 1; i >= 0; i--) {
+    if (rank < sketch->negative[i]) return -BucketValue(sketch, i);
+    rank -= sketch->negative[i];
+  }
+  if (rank < sketch->zero) return 0;
+  rank -= sketch->zero;
+  for (int i = 0; i < sketch->buckets_num; i++) {
+    if (rank < sketch->positive[i]) return BucketValue(sketch, i);
+    rank -= sketch->positive[i];
+  }
+  return 0;
+}
+
+size_t SketchBytes(const struct QuantileSketch *sketch) {
+  return 2 * sizeof(uint64_t) * sketch->buckets_num;
+}
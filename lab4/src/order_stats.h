@@ -0,0 +1,75 @@
+#ifndef ORDER_STATS_H
+#define ORDER_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The k smallest (or, with largest, the k largest) values seen so far, in
+// a bounded heap. Values are stored as keys where smaller is always
+// "better": x itself, or ~x for largest, which reverses int order. A
+// full heap rejects most values with a single comparison against its root.
+struct TopK {
+  int *keys;
+  int size;
+  int capacity;
+  bool largest;
+};
+
+void TopKInit(struct TopK *top, int k, bool largest);
+void TopKFree(struct TopK *top);
+void TopKScan(struct TopK *top, const int *array, unsigned int begin,
+              unsigned int end);
+// Adds every value other holds.
+void TopKMerge(struct TopK *into, const struct TopK *other);
+// Writes the kept values to out, best first, and returns how many.
+int TopKSorted(const struct TopK *top, int *out);
+
+// Exact quantiles by parallel radix select over 16-bit digits. Pass one
+// counts the high digit of every value; the digit holding each wanted rank
+// is then found from the merged counts. Pass two counts the low digit of
+// just the values in those high buckets. Two scans in total, with
+// 256 KiB of counts per worker per pass, whatever the array size.
+#define RADIX_BUCKETS 65536
+
+// Adds the high digits of [begin, end) to counts[RADIX_BUCKETS].
+void RadixCountHigh(const int *array, unsigned int begin, unsigned int end,
+                    uint32_t *counts);
+// For values whose high digit has targets[high] >= 0, adds their low digit
+// to counts[targets[high] * RADIX_BUCKETS + low].
+void RadixCountLow(const int *array, unsigned int begin, unsigned int end,
+                   const int *targets, uint32_t *counts);
+// Finds the bucket holding the 0-based rank and turns rank into the rank
+// within that bucket.
+int RadixFindBucket(const uint64_t *counts, uint64_t *rank);
+int RadixValue(int high, int low);
+
+// 0-based rank of quantile q in count values (nearest rank, so q = 0 is
+// the minimum and q = 1 the maximum).
+uint64_t QuantileRank(double q, uint64_t count);
+
+// A DDSketch-style quantile sketch: counts per logarithmic bucket, so any
+// quantile it returns is within a relative error alpha of the exact one.
+// Memory depends only on alpha, sketches merge by adding counts, and
+// values are mapped with a linearly interpolated log2 taken from the
+// double exponent and mantissa bits instead of calling log().
+struct QuantileSketch {
+  double alpha;
+  double multiplier;
+  int buckets_num;
+  uint64_t *positive;
+  uint64_t *negative;
+  uint64_t zero;
+  uint64_t count;
+};
+
+void SketchInit(struct QuantileSketch *sketch, double alpha);
+void SketchFree(struct QuantileSketch *sketch);
+void SketchAddRange(struct QuantileSketch *sketch, const int *array,
+                    unsigned int begin, unsigned int end);
+void SketchMerge(struct QuantileSketch *into,
+                 const struct QuantileSketch *other);
+double SketchQuantile(const struct QuantileSketch *sketch, double q);
+size_t SketchBytes(const struct QuantileSketch *sketch);
+
+#endif
@@ -1,4 +1,5 @@
 #include <ctype.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -9,15 +10,70 @@
 #include <signal.h>
 #include <errno.h>
 
-#include <sys/time.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include <getopt.h>
+#include <pthread.h>
 
+#include "affinity.h"
+#include "alloc.h"
 #include "find_min_max.h"
+#include "input.h"
 #include "utils.h"
 
+#define DEFAULT_CHUNK_SIZE (1 << 16)
+
+enum ResultChannel { CHANNEL_PIPES, CHANNEL_FILES, CHANNEL_SHM };
+
+// What a worker reports. stats is only filled in with --stats, and then
+// carries min and max with their positions as well.
+struct WorkerResult {
+  struct MinMax64 min_max;
+  struct ArrayStats stats;
+};
+
+// One slot per child in a shared anonymous mapping. Padding keeps children
+// that finish at the same time from bouncing a cache line between cores.
+struct ResultSlot {
+  struct WorkerResult result;
+  int ready;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// The array being reduced: either generated ints, or a mapped --input file
+// (input is NULL for generated arrays) read through array or array64
+// depending on its element width.
+struct Dataset {
+  int *array;
+  const int64_t *array64;
+  int size;
+  const struct MappedInput *input;
+};
+
+// State shared by the thread team: workers claim [cursor, cursor + chunk)
+// until the array is exhausted. With first-touch placement each worker
+// instead generates and scans a fixed segment, so it only reads pages
+// that were faulted in on its own node.
+struct ThreadTeam {
+  const struct Dataset *data;
+  unsigned int chunk_size;
+  unsigned long long cursor;
+  const struct Placement *placement;
+  unsigned int seed;
+  int workers_num;
+  bool want_stats;
+};
+
+struct ThreadArgs {
+  struct ThreadTeam *team;
+  int index;
+  struct WorkerResult result;
+  bool completed;
+  // NULL unless --timing was given.
+  struct WorkerTiming *timing;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
 pid_t *child_pids = NULL;
 int timeout = 0;
 volatile sig_atomic_t timeout_reached = 0;
@@ -26,7 +82,7 @@ void timeout_handler(int sig) {
     if (sig == SIGALRM) {
         timeout_reached = 1;
         printf("Timeout reached!\n");
-        for (int i = 0; child_pids[i] != 0; i++) {
+        for (int i = 0; child_pids != NULL && child_pids[i] != 0; i++) {
             if (child_pids[i] > 0) {
                 kill(child_pids[i], SIGKILL);
             }
@@ -34,182 +90,274 @@ void timeout_handler(int sig) {
     }
 }
 
-int main(int argc, char **argv) {
-  int seed = -1;
-  int array_size = -1;
-  int pnum = -1;
-  bool with_files = false;
-  timeout = 0;
+static void MergeMinMax(struct MinMax64 *into, int64_t min, int64_t max) {
+  if (min < into->min) into->min = min;
+  if (max > into->max) into->max = max;
+}
 
-  while (true) {
-    int current_optind = optind ? optind : 1;
+static void InitResult(struct WorkerResult *result) {
+  memset(result, 0, sizeof(*result));
+  result->min_max.min = INT64_MAX;
+  result->min_max.max = INT64_MIN;
+}
 
-    static struct option options[] = {{"seed", required_argument, 0, 0},
-                                      {"array_size", required_argument, 0, 0},
-                                      {"pnum", required_argument, 0, 0},
-                                      {"by_files", no_argument, 0, 'f'},
-                                      {"timeout", required_argument, 0, 0},
-                                      {0, 0, 0, 0}};
+static void MergeResult(struct WorkerResult *into,
+                        const struct WorkerResult *other) {
+  MergeMinMax(&into->min_max, other->min_max.min, other->min_max.max);
+  MergeArrayStats(&into->stats, &other->stats);
+}
 
-    int option_index = 0;
-    int c = getopt_long(argc, argv, "f", options, &option_index);
+// --stats is only offered for int arrays, so array64 is NULL then.
+static struct WorkerResult SegmentResult(const struct Dataset *data,
+                                         int begin, int end, bool want_stats) {
+  struct WorkerResult result;
+  InitResult(&result);
+  PrefetchInput(data->input, begin, end);
+  if (want_stats) {
+    result.stats = GetArrayStats(data->array, begin, end);
+    result.min_max.min = result.stats.min_max.min;
+    result.min_max.max = result.stats.min_max.max;
+  } else if (data->array64 != NULL) {
+    result.min_max = GetMinMax64(data->array64, begin, end);
+  } else {
+    struct MinMax min_max = GetMinMax(data->array, begin, end);
+    result.min_max.min = min_max.min;
+    result.min_max.max = min_max.max;
+  }
+  return result;
+}
 
-    if (c == -1) break;
+static void WorkerSegment(int worker, int workers_num, int array_size,
+                          int *begin, int *end) {
+  int segment_size = array_size / workers_num;
+  *begin = worker * segment_size;
+  *end = (worker == workers_num - 1) ? array_size
+                                     : (worker + 1) * segment_size;
+}
 
-    switch (c) {
-      case 0:
-        switch (option_index) {
-          case 0:
-            seed = atoi(optarg);
-            if (seed <= 0) {
-                printf("seed must be a positive number\n");
-                return 1;
-            }
-            break;
-          case 1:
-            array_size = atoi(optarg);
-            if (array_size <= 0) {
-                printf("array_size must be a positive number\n");
-                return 1;
-            }
-            break;
-          case 2:
-            pnum = atoi(optarg);
-            if (pnum <= 0) {
-                printf("pnum must be a positive number\n");
-                return 1;
-            }
-            break;
-          case 3:
-            with_files = true;
-            break;
-          case 4:
-            timeout = atoi(optarg);
-            if (timeout <= 0) {
-                printf("timeout must be a positive number\n");
-                return 1;
-            }
-            break;
+void *ThreadMinMax(void *args) {
+  struct ThreadArgs *thread_args = (struct ThreadArgs *)args;
+  struct ThreadTeam *team = thread_args->team;
+  const struct Dataset *data = team->data;
+
+  InitResult(&thread_args->result);
+  PinSelf(PlacementCpu(team->placement, thread_args->index));
+  if (thread_args->timing)
+    BeginWorkerTiming(thread_args->timing);
+
+  if (team->placement->first_touch) {
+    int begin, end;
+    WorkerSegment(thread_args->index, team->workers_num, data->size, &begin,
+                  &end);
+    GenerateArrayRange(data->array, begin, end, team->seed);
+    thread_args->result = SegmentResult(data, begin, end, team->want_stats);
+    thread_args->completed = !timeout_reached;
+  }
 
-          default:
-            printf("Index %d is out of options\n", option_index);
-        }
-        break;
-      case 'f':
-        with_files = true;
-        break;
+  while (!thread_args->completed && !timeout_reached) {
+    unsigned long long begin = __atomic_fetch_add(
+        &team->cursor, team->chunk_size, __ATOMIC_RELAXED);
+    if (begin >= (unsigned long long)data->size) {
+      thread_args->completed = true;
+      break;
+    }
+    unsigned long long end = begin + team->chunk_size;
+    if (end > (unsigned long long)data->size) end = data->size;
 
-      case '?':
-        break;
+    struct WorkerResult local_result =
+        SegmentResult(data, begin, end, team->want_stats);
+    MergeResult(&thread_args->result, &local_result);
+  }
+  if (thread_args->timing && thread_args->completed)
+    EndWorkerTiming(thread_args->timing);
+  return NULL;
+}
 
-      default:
-        printf("getopt returned character code 0%o?\n", c);
+// Runs the reduction on a pthread team. Returns how many threads finished
+// before the timeout, or -1 if the team could not be started. With
+// timings, fills one entry per thread and the spawn and reduce phases.
+static int RunThreads(const struct Dataset *data, int pnum,
+                      unsigned int chunk_size,
+                      const struct Placement *placement, unsigned int seed,
+                      bool want_stats, struct WorkerResult *result,
+                      struct WorkerTiming *timings,
+                      struct PhaseTiming *phases, double *spawn_start_ms) {
+  struct ThreadTeam team = {data,      chunk_size, 0, placement,
+                            seed,      pnum,       want_stats};
+  pthread_t *threads = malloc(sizeof(pthread_t) * pnum);
+  struct ThreadArgs *args = aligned_alloc(
+      CACHE_LINE_SIZE, sizeof(struct ThreadArgs) * pnum);
+
+  *spawn_start_ms = MonotonicMs();
+  for (int i = 0; i < pnum; i++) {
+    args[i].team = &team;
+    args[i].index = i;
+    args[i].completed = false;
+    args[i].timing = timings ? &timings[i] : NULL;
+    if (pthread_create(&threads[i], NULL, ThreadMinMax, &args[i])) {
+      printf("Error: pthread_create failed!\n");
+      return -1;
     }
   }
+  phases->spawn_ms = MonotonicMs() - *spawn_start_ms;
 
-  if (optind < argc) {
-    printf("Has at least one no option argument\n");
-    return 1;
+  int completed_count = 0;
+  for (int i = 0; i < pnum; i++) {
+    pthread_join(threads[i], NULL);
+    if (args[i].completed) {
+      MergeResult(result, &args[i].result);
+      completed_count++;
+    }
   }
+  if (timings)
+    phases->reduce_ms = MonotonicMs() - LastWorkerEnd(timings, pnum);
 
-  if (seed == -1 || array_size == -1 || pnum == -1) {
-    printf("Usage: %s --seed \"num\" --array_size \"num\" --pnum \"num\" [--timeout \"num\"]\n",
-           argv[0]);
-    return 1;
-  }
+  free(threads);
+  free(args);
+  return completed_count;
+}
 
+// Runs the reduction in pnum forked children that report back through the
+// chosen channel. Returns how many children delivered a result, or -1 if
+// they could not be started. With timings, fills one entry per child and
+// the spawn and reduce phases.
+static int RunProcesses(const struct Dataset *data, int pnum,
+                        enum ResultChannel channel,
+                        const struct Placement *placement, unsigned int seed,
+                        bool want_stats, struct WorkerResult *result,
+                        struct WorkerTiming *timings,
+                        struct PhaseTiming *phases, double *spawn_start_ms) {
   child_pids = malloc(sizeof(pid_t) * (pnum + 1));
   for (int i = 0; i <= pnum; i++) {
       child_pids[i] = 0;
   }
 
-  int *array = malloc(sizeof(int) * array_size);
-  GenerateArray(array, array_size, seed);
   int active_child_processes = 0;
 
-  int pipes[pnum][2];
-  if (!with_files) {
+  int pipes[channel == CHANNEL_PIPES ? pnum : 1][2];
+  if (channel == CHANNEL_PIPES) {
     for (int i = 0; i < pnum; i++) {
       if (pipe(pipes[i]) == -1) {
         printf("Pipe creation failed!\n");
-        return 1;
+        return -1;
       }
     }
   }
 
-  bool *process_completed = malloc(sizeof(bool) * pnum);
-  for (int i = 0; i < pnum; i++) {
-      process_completed[i] = false;
+  struct ResultSlot *slots = NULL;
+  size_t slots_size = sizeof(struct ResultSlot) * pnum;
+  if (channel == CHANNEL_SHM) {
+    // Mapped before fork so every child shares it; MAP_ANONYMOUS memory
+    // is zero-filled, so all ready flags start cleared.
+    slots = mmap(NULL, slots_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (slots == MAP_FAILED) {
+      printf("Shared memory mapping failed!\n");
+      return -1;
+    }
   }
 
-  if (timeout > 0) {
-      signal(SIGALRM, timeout_handler);
-      alarm(timeout);
+  // Children report timings through their own shared mapping, whatever
+  // the result channel is.
+  struct WorkerTiming *shared_timings = NULL;
+  size_t timings_size = sizeof(struct WorkerTiming) * pnum;
+  if (timings) {
+    shared_timings = mmap(NULL, timings_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared_timings == MAP_FAILED) {
+      printf("Shared memory mapping failed!\n");
+      return -1;
+    }
   }
 
-  struct timeval start_time;
-  gettimeofday(&start_time, NULL);
+  bool *process_completed = malloc(sizeof(bool) * pnum);
+  for (int i = 0; i < pnum; i++) {
+      process_completed[i] = false;
+  }
 
+  *spawn_start_ms = MonotonicMs();
   for (int i = 0; i < pnum; i++) {
     pid_t child_pid = fork();
     if (child_pid >= 0) {
       active_child_processes += 1;
       child_pids[i] = child_pid;
       if (child_pid == 0) {
-        int segment_size = array_size / pnum;
-        int begin = i * segment_size;
-        int end = (i == pnum - 1) ? array_size : (i + 1) * segment_size;
-
-        struct MinMax local_min_max = GetMinMax(array, begin, end);
-
-        if (with_files) {
+        int begin, end;
+        WorkerSegment(i, pnum, data->size, &begin, &end);
+
+        PinSelf(PlacementCpu(placement, i));
+        if (shared_timings)
+          BeginWorkerTiming(&shared_timings[i]);
+        // The parent never touched the array, so these writes fault in
+        // fresh pages local to this child rather than copying shared ones.
+        if (placement->first_touch)
+          GenerateArrayRange(data->array, begin, end, seed);
+        struct WorkerResult local_result =
+            SegmentResult(data, begin, end, want_stats);
+
+        if (channel == CHANNEL_SHM) {
+          slots[i].result = local_result;
+          __atomic_store_n(&slots[i].ready, 1, __ATOMIC_RELEASE);
+        } else if (channel == CHANNEL_FILES) {
           char filename[32];
           sprintf(filename, "min_max_%d.txt", i);
           FILE *file = fopen(filename, "w");
           if (file != NULL) {
-            fprintf(file, "%d %d", local_min_max.min, local_min_max.max);
+            fprintf(file, "%" PRId64 " %" PRId64, local_result.min_max.min,
+                    local_result.min_max.max);
+            // %a keeps m2 exact through the text round trip.
+            const struct ArrayStats *stats = &local_result.stats;
+            if (want_stats) {
+              fprintf(file, " %u %u %" PRIu64 " %" PRId64 " %a", stats->argmin,
+                      stats->argmax, stats->count, stats->sum, stats->m2);
+            }
             fclose(file);
           }
         } else {
           close(pipes[i][0]);
-          write(pipes[i][1], &local_min_max.min, sizeof(int));
-          write(pipes[i][1], &local_min_max.max, sizeof(int));
+          // Smaller than PIPE_BUF, so it arrives in one piece.
+          write(pipes[i][1], &local_result, sizeof(local_result));
           close(pipes[i][1]);
         }
-        free(array);
-        return 0;
+        if (shared_timings)
+          EndWorkerTiming(&shared_timings[i]);
+        exit(0);
       }
 
     } else {
       printf("Fork failed!\n");
-      return 1;
+      return -1;
     }
   }
+  phases->spawn_ms = MonotonicMs() - *spawn_start_ms;
 
+  // Blocks until each child exits, so results are collected as soon as
+  // they exist. On timeout the handler kills the rest, and waitpid either
+  // reaps them or fails with EINTR.
   while (active_child_processes > 0) {
       int status;
-      pid_t finished_pid = waitpid(-1, &status, WNOHANG);
-      
+      pid_t finished_pid = waitpid(-1, &status, 0);
+
       if (finished_pid > 0) {
           active_child_processes -= 1;
-          
+
+          // -1 rather than 0, which ends the list timeout_handler walks.
           for (int i = 0; i < pnum; i++) {
               if (child_pids[i] == finished_pid) {
                   process_completed[i] = true;
-                  child_pids[i] = 0;
+                  child_pids[i] = -1;
                   break;
               }
           }
-          
+
           if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-          } else {
+          } else if (!timeout_reached) {
               printf("Child process %d terminated abnormally\n", finished_pid);
           }
-      } else if (finished_pid == 0) {
+      } else if (errno == EINTR) {
           if (timeout_reached) {
               break;
           }
-          usleep(10000);
       } else {
           if (errno != ECHILD) {
               perror("waitpid");
@@ -218,28 +366,38 @@ int main(int argc, char **argv) {
       }
   }
 
-  if (timeout > 0) {
-      alarm(0);
-  }
-
-  struct MinMax min_max;
-  min_max.min = INT_MAX;
-  min_max.max = INT_MIN;
-
   int completed_count = 0;
   for (int i = 0; i < pnum; i++) {
-    int min = INT_MAX;
-    int max = INT_MIN;
+    struct WorkerResult local_result;
+    InitResult(&local_result);
     bool valid_data = false;
 
     if (process_completed[i]) {
-        if (with_files) {
+        if (channel == CHANNEL_SHM) {
+          if (__atomic_load_n(&slots[i].ready, __ATOMIC_ACQUIRE)) {
+              local_result = slots[i].result;
+              valid_data = true;
+              completed_count++;
+          }
+        } else if (channel == CHANNEL_FILES) {
           char filename[32];
           sprintf(filename, "min_max_%d.txt", i);
           FILE *file = fopen(filename, "r");
           if (file != NULL) {
-            if (fscanf(file, "%d %d", &min, &max) == 2) {
-                valid_data = true;
+            struct ArrayStats *stats = &local_result.stats;
+            valid_data = fscanf(file, "%" SCNd64 " %" SCNd64,
+                                &local_result.min_max.min,
+                                &local_result.min_max.max) == 2;
+            if (valid_data && want_stats) {
+                valid_data = fscanf(file,
+                                    " %u %u %" SCNu64 " %" SCNd64 " %la",
+                                    &stats->argmin, &stats->argmax,
+                                    &stats->count, &stats->sum,
+                                    &stats->m2) == 5;
+                stats->min_max.min = local_result.min_max.min;
+                stats->min_max.max = local_result.min_max.max;
+            }
+            if (valid_data) {
                 completed_count++;
             }
             fclose(file);
@@ -247,8 +405,8 @@ int main(int argc, char **argv) {
           }
         } else {
           close(pipes[i][1]);
-          if (read(pipes[i][0], &min, sizeof(int)) == sizeof(int) &&
-              read(pipes[i][0], &max, sizeof(int)) == sizeof(int)) {
+          if (read(pipes[i][0], &local_result, sizeof(local_result)) ==
+              sizeof(local_result)) {
               valid_data = true;
               completed_count++;
           }
@@ -256,33 +414,329 @@ int main(int argc, char **argv) {
         }
 
         if (valid_data) {
-            if (min < min_max.min) min_max.min = min;
-            if (max > min_max.max) min_max.max = max;
+            MergeResult(result, &local_result);
         }
     }
   }
 
-  struct timeval finish_time;
-  gettimeofday(&finish_time, NULL);
+  if (shared_timings != NULL) {
+      memcpy(timings, shared_timings, timings_size);
+      munmap(shared_timings, timings_size);
+      phases->reduce_ms = MonotonicMs() - LastWorkerEnd(timings, pnum);
+  }
+  if (slots != NULL) {
+      munmap(slots, slots_size);
+  }
+  free(process_completed);
+  return completed_count;
+}
+
+int main(int argc, char **argv) {
+  int seed = -1;
+  int array_size = -1;
+  int pnum = -1;
+  enum ResultChannel channel = CHANNEL_PIPES;
+  bool use_threads = false;
+  int chunk_size = DEFAULT_CHUNK_SIZE;
+  bool timing = false;
+  struct Placement placement = {PIN_NONE, false, NULL, 0, 1};
+  const char *input_path = NULL;
+  enum ElementType input_type = ELEMENT_INT32;
+  enum PageBacking backing = PAGES_DEFAULT;
+  bool prefault = false;
+  bool want_stats = false;
+  timeout = 0;
+
+  while (true) {
+    int current_optind = optind ? optind : 1;
 
-  double elapsed_time = (finish_time.tv_sec - start_time.tv_sec) * 1000.0;
-  elapsed_time += (finish_time.tv_usec - start_time.tv_usec) / 1000.0;
+    static struct option options[] = {{"seed", required_argument, 0, 0},
+                                      {"array_size", required_argument, 0, 0},
+                                      {"pnum", required_argument, 0, 0},
+                                      {"by_files", no_argument, 0, 'f'},
+                                      {"timeout", required_argument, 0, 0},
+                                      {"by_shm", no_argument, 0, 0},
+                                      {"threads", no_argument, 0, 0},
+                                      {"chunk_size", required_argument, 0, 0},
+                                      {"timing", no_argument, 0, 0},
+                                      {"pin", required_argument, 0, 0},
+                                      {"numa", no_argument, 0, 0},
+                                      {"input", required_argument, 0, 0},
+                                      {"input_type", required_argument, 0, 0},
+                                      {"pages", required_argument, 0, 0},
+                                      {"prefault", no_argument, 0, 0},
+                                      {"stats", no_argument, 0, 0},
+                                      {0, 0, 0, 0}};
 
-  free(array);
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "f", options, &option_index);
+
+    if (c == -1) break;
+
+    switch (c) {
+      case 0:
+        switch (option_index) {
+          case 0:
+            seed = atoi(optarg);
+            if (seed <= 0) {
+                printf("seed must be a positive number\n");
+                return 1;
+            }
+            break;
+          case 1:
+            array_size = atoi(optarg);
+            if (array_size <= 0) {
+                printf("array_size must be a positive number\n");
+                return 1;
+            }
+            break;
+          case 2:
+            pnum = atoi(optarg);
+            if (pnum <= 0) {
+                printf("pnum must be a positive number\n");
+                return 1;
+            }
+            break;
+          case 3:
+            channel = CHANNEL_FILES;
+            break;
+          case 4:
+            timeout = atoi(optarg);
+            if (timeout <= 0) {
+                printf("timeout must be a positive number\n");
+                return 1;
+            }
+            break;
+          case 5:
+            channel = CHANNEL_SHM;
+            break;
+          case 6:
+            use_threads = true;
+            break;
+          case 7:
+            chunk_size = atoi(optarg);
+            if (chunk_size <= 0) {
+                printf("chunk_size must be a positive number\n");
+                return 1;
+            }
+            break;
+          case 8:
+            timing = true;
+            break;
+          case 9:
+            if (!ParsePinPolicy(optarg, &placement.policy)) {
+                printf("pin must be none, compact or scatter\n");
+                return 1;
+            }
+            break;
+          case 10:
+            placement.first_touch = true;
+            break;
+          case 11:
+            input_path = optarg;
+            break;
+          case 12:
+            if (!ParseElementType(optarg, &input_type)) {
+                printf("input_type must be int32 or int64\n");
+                return 1;
+            }
+            break;
+          case 13:
+            if (!ParsePageBacking(optarg, &backing)) {
+                printf("pages must be default, thp or hugetlb\n");
+                return 1;
+            }
+            break;
+          case 14:
+            prefault = true;
+            break;
+          case 15:
+            want_stats = true;
+            break;
+
+          default:
+            printf("Index %d is out of options\n", option_index);
+        }
+        break;
+      case 'f':
+        channel = CHANNEL_FILES;
+        break;
+
+      case '?':
+        break;
+
+      default:
+        printf("getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  if (optind < argc) {
+    printf("Has at least one no option argument\n");
+    return 1;
+  }
+
+  // A mapped --input replaces the generated array; --array_size then
+  // optionally limits the run to a prefix of the file.
+  if (pnum == -1 || (input_path == NULL && (seed == -1 || array_size == -1))) {
+    printf("Usage: %s --seed \"num\" --array_size \"num\" --pnum \"num\" [--timeout \"num\"] [--by_files | --by_shm | --threads [--chunk_size \"num\"]] [--timing] [--pin none|compact|scatter] [--numa] [--pages default|thp|hugetlb] [--prefault] [--stats]\n"
+           "       %s --input \"path\" [--input_type int32|int64] [--array_size \"num\"] --pnum \"num\" [...]\n",
+           argv[0], argv[0]);
+    return 1;
+  }
+  if (input_path != NULL && placement.first_touch) {
+    printf("--numa generates the array in place and cannot be used with --input\n");
+    return 1;
+  }
+  if (want_stats && input_type == ELEMENT_INT64) {
+    printf("--stats supports int32 data only\n");
+    return 1;
+  }
+  if (prefault && placement.first_touch) {
+    printf("--prefault would touch the array before the --numa workers do\n");
+    return 1;
+  }
+
+  // --numa without an explicit policy spreads workers over the nodes.
+  if (placement.first_touch && placement.policy == PIN_NONE) {
+    placement.policy = PIN_SCATTER;
+  }
+  if (!BuildPlacement(&placement)) {
+    printf("Could not read the CPU topology\n");
+    return 1;
+  }
+
+  struct PhaseTiming phases = {0};
+  double phase_start = MonotonicMs();
+  struct MappedInput input = {NULL, 0, 0, input_type};
+  struct ArrayAllocation allocation = {0};
+  int *array = NULL;
+  if (input_path != NULL) {
+    if (!MapInput(input_path, input_type, &input)) {
+      return 1;
+    }
+    if (input.count > INT_MAX) {
+      printf("%s: %zu elements, at most %d are supported\n", input_path,
+             input.count, INT_MAX);
+      return 1;
+    }
+    if (array_size == -1 || (size_t)array_size > input.count) {
+      array_size = input.count;
+    }
+    if (input_type == ELEMENT_INT32) {
+      array = (int *)input.data;
+    }
+  } else {
+    // Without --prefault the pages stay untouched until first written,
+    // which --numa relies on.
+    array = AllocateArray(sizeof(int) * array_size, backing, prefault,
+                          &allocation);
+    if (array == NULL) {
+      printf("Array allocation failed!\n");
+      return 1;
+    }
+  }
+  phases.alloc_ms = MonotonicMs() - phase_start;
+
+  // With first-touch placement the workers generate their own segments,
+  // so generation shows up in their compute time and in Elapsed time.
+  if (input_path == NULL && !placement.first_touch) {
+    phase_start = MonotonicMs();
+    GenerateArray(array, array_size, seed);
+    phases.generate_ms = MonotonicMs() - phase_start;
+  }
+  struct Dataset data = {
+      array, input_type == ELEMENT_INT64 ? input.data : NULL, array_size,
+      input_path != NULL ? &input : NULL};
+
+  struct WorkerTiming *timings = NULL;
+  if (timing) {
+    timings = aligned_alloc(CACHE_LINE_SIZE,
+                            sizeof(struct WorkerTiming) * pnum);
+    memset(timings, 0, sizeof(struct WorkerTiming) * pnum);
+  }
+
+  if (timeout > 0) {
+      signal(SIGALRM, timeout_handler);
+      alarm(timeout);
+  }
+
+  struct WorkerResult result;
+  InitResult(&result);
+
+  double start_time = MonotonicMs();
+  double spawn_start_ms = start_time;
+
+  int completed_count;
+  if (use_threads) {
+    completed_count = RunThreads(&data, pnum, chunk_size,
+                                 &placement, seed, want_stats, &result,
+                                 timings, &phases, &spawn_start_ms);
+  } else {
+    completed_count = RunProcesses(&data, pnum, channel,
+                                   &placement, seed, want_stats, &result,
+                                   timings, &phases, &spawn_start_ms);
+  }
+  if (completed_count < 0) {
+    return 1;
+  }
+
+  if (timeout > 0) {
+      alarm(0);
+  }
+
+  double elapsed_time = MonotonicMs() - start_time;
+
+  bool report_pages = input_path == NULL &&
+                      (backing != PAGES_DEFAULT || prefault);
+  if (report_pages) {
+    MeasureAllocation(&allocation);
+  }
+
+  phase_start = MonotonicMs();
+  if (input_path != NULL) {
+    UnmapInput(&input);
+  } else {
+    FreeArray(&allocation);
+  }
   free(child_pids);
-  free(process_completed);
+  phases.teardown_ms = MonotonicMs() - phase_start;
 
+  const char *workers = use_threads ? "threads" : "processes";
   if (completed_count > 0) {
-      printf("Min: %d\n", min_max.min);
-      printf("Max: %d\n", min_max.max);
-      printf("Completed processes: %d/%d\n", completed_count, pnum);
+      printf("Min: %" PRId64 "\n", result.min_max.min);
+      printf("Max: %" PRId64 "\n", result.min_max.max);
+      if (want_stats) {
+        printf("Argmin: %u\n", result.stats.argmin);
+        printf("Argmax: %u\n", result.stats.argmax);
+        printf("Count: %" PRIu64 "\n", result.stats.count);
+        printf("Sum: %" PRId64 "\n", result.stats.sum);
+        printf("Mean: %.6f\n", ArrayStatsMean(&result.stats));
+        printf("Variance: %.6f\n", ArrayStatsVariance(&result.stats));
+      }
+      printf("Completed %s: %d/%d\n", workers, completed_count, pnum);
   } else {
-      printf("No processes completed successfully within timeout\n");
-      min_max.min = 0;
-      min_max.max = 0;
+      printf("No %s completed successfully within timeout\n", workers);
+      result.min_max.min = 0;
+      result.min_max.max = 0;
   }
-  
+
+  // int64 --input files go through the plain GetMinMax64 loop, not the
+  // dispatched kernels.
+  printf("Kernel: %s\n", input_type == ELEMENT_INT64
+                              ? "int64-scalar"
+                              : MinMaxImplName(GetMinMaxImpl()));
   printf("Elapsed time: %fms\n", elapsed_time);
+  if (placement.policy != PIN_NONE) {
+    PrintPlacement(&placement, pnum);
+  }
+  if (report_pages)
+    PrintAllocation(&allocation);
+  FreePlacement(&placement);
+  if (timing) {
+    PrintTiming(&phases, timings, pnum, spawn_start_ms,
+                use_threads ? "thread" : "process");
+    free(timings);
+  }
   fflush(NULL);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,329 @@
+// parallel_quantile.c
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <pthread.h>
+
+#include "order_stats.h"
+#include "utils.h"
+
+#define MAX_QUANTILES 32
+#define DEFAULT_QUANTILES "0.5,0.9,0.99"
+#define DEFAULT_ALPHA 0.01
+
+enum QuantilePass { PASS_HIGH, PASS_LOW, PASS_SKETCH };
+
+struct QuantileSlot {
+  int *array;
+  unsigned int begin;
+  unsigned int end;
+  enum QuantilePass pass;
+  // Radix passes: per-worker digit counts, and for PASS_LOW the map from
+  // high digit to target.
+  uint32_t *counts;
+  const int *targets;
+  struct QuantileSketch sketch;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+void *ThreadQuantile(void *args) {
+  struct QuantileSlot *slot = (struct QuantileSlot *)args;
+  switch (slot->pass) {
+    case PASS_HIGH:
+      RadixCountHigh(slot->array, slot->begin, slot->end, slot->counts);
+      break;
+    case PASS_LOW:
+      RadixCountLow(slot->array, slot->begin, slot->end, slot->targets,
+                    slot->counts);
+      break;
+    case PASS_SKETCH:
+      SketchAddRange(&slot->sketch, slot->array, slot->begin, slot->end);
+      break;
+  }
+  return NULL;
+}
+
+// Runs one pass on every slot and waits for all of them.
+static bool RunPass(struct QuantileSlot *slots, uint32_t threads_num,
+                    enum QuantilePass pass) {
+  pthread_t threads[threads_num];
+  for (uint32_t i = 0; i < threads_num; i++) {
+    slots[i].pass = pass;
+    if (pthread_create(&threads[i], NULL, ThreadQuantile, &slots[i])) {
+      printf("Error: pthread_create failed!\n");
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < threads_num; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return true;
+}
+
+// Adds every worker's counts (buckets_num of them each) into totals.
+static void MergeCounts(struct QuantileSlot *slots, uint32_t threads_num,
+                        size_t buckets_num, uint64_t *totals) {
+  memset(totals, 0, sizeof(uint64_t) * buckets_num);
+  for (uint32_t i = 0; i < threads_num; i++) {
+    for (size_t b = 0; b < buckets_num; b++) {
+      totals[b] += slots[i].counts[b];
+    }
+    free(slots[i].counts);
+    slots[i].counts = NULL;
+  }
+}
+
+// Exact answers in two scans; returns the working memory used.
+static size_t ExactQuantiles(struct QuantileSlot *slots, uint32_t threads_num,
+                             unsigned int array_size, const double *quantiles,
+                             int quantiles_num, double *answers) {
+  for (uint32_t i = 0; i < threads_num; i++) {
+    slots[i].counts = calloc(RADIX_BUCKETS, sizeof(uint32_t));
+  }
+  size_t memory = sizeof(uint32_t) * RADIX_BUCKETS * threads_num;
+  if (!RunPass(slots, threads_num, PASS_HIGH)) exit(1);
+  uint64_t *totals = malloc(sizeof(uint64_t) * RADIX_BUCKETS);
+  MergeCounts(slots, threads_num, RADIX_BUCKETS, totals);
+
+  // Quantiles landing in the same high bucket share one low histogram.
+  int *targets = malloc(sizeof(int) * RADIX_BUCKETS);
+  for (int b = 0; b < RADIX_BUCKETS; b++) targets[b] = -1;
+  int highs[MAX_QUANTILES];
+  uint64_t ranks[MAX_QUANTILES];
+  int targets_num = 0;
+  for (int q = 0; q < quantiles_num; q++) {
+    ranks[q] = QuantileRank(quantiles[q], array_size);
+    highs[q] = RadixFindBucket(totals, &ranks[q]);
+    if (targets[highs[q]] < 0) targets[highs[q]] = targets_num++;
+  }
+
+  size_t low_buckets = (size_t)RADIX_BUCKETS * targets_num;
+  for (uint32_t i = 0; i < threads_num; i++) {
+    slots[i].counts = calloc(low_buckets, sizeof(uint32_t));
+    slots[i].targets = targets;
+  }
+  size_t low_memory = sizeof(uint32_t) * low_buckets * threads_num;
+  if (low_memory > memory) memory = low_memory;
+  if (!RunPass(slots, threads_num, PASS_LOW)) exit(1);
+  uint64_t *low_totals = malloc(sizeof(uint64_t) * low_buckets);
+  MergeCounts(slots, threads_num, low_buckets, low_totals);
+
+  for (int q = 0; q < quantiles_num; q++) {
+    const uint64_t *counts =
+        low_totals + (size_t)targets[highs[q]] * RADIX_BUCKETS;
+    int low = RadixFindBucket(counts, &ranks[q]);
+    answers[q] = RadixValue(highs[q], low);
+  }
+
+  free(low_totals);
+  free(targets);
+  free(totals);
+  return memory;
+}
+
+// One scan into per-worker sketches; returns the working memory used.
+static size_t ApproxQuantiles(struct QuantileSlot *slots, uint32_t threads_num,
+                              double alpha, const double *quantiles,
+                              int quantiles_num, double *answers) {
+  for (uint32_t i = 0; i < threads_num; i++) {
+    SketchInit(&slots[i].sketch, alpha);
+  }
+  if (!RunPass(slots, threads_num, PASS_SKETCH)) exit(1);
+  for (uint32_t i = 1; i < threads_num; i++) {
+    SketchMerge(&slots[0].sketch, &slots[i].sketch);
+  }
+  for (int q = 0; q < quantiles_num; q++) {
+    answers[q] = SketchQuantile(&slots[0].sketch, quantiles[q]);
+  }
+  size_t memory = SketchBytes(&slots[0].sketch) * threads_num;
+  for (uint32_t i = 0; i < threads_num; i++) {
+    SketchFree(&slots[i].sketch);
+  }
+  return memory;
+}
+
+static int CompareInts(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+// Checks the answers against a full sort of a copy of the array. Exact
+// answers must match; approximate ones must be within alpha (plus half a
+// unit, since they are reported as whole numbers).
+static bool VerifyQuantiles(const int *array, unsigned int array_size,
+                            const double *quantiles, int quantiles_num,
+                            const double *answers, bool approx,
+                            double alpha) {
+  int *sorted = malloc(sizeof(int) * array_size);
+  memcpy(sorted, array, sizeof(int) * array_size);
+  double start = MonotonicMs();
+  qsort(sorted, array_size, sizeof(int), CompareInts);
+  printf("Full sort: %fms\n", MonotonicMs() - start);
+
+  bool ok = true;
+  double worst_error = 0;
+  for (int q = 0; q < quantiles_num; q++) {
+    double expected = sorted[QuantileRank(quantiles[q], array_size)];
+    double error = fabs(round(answers[q]) - expected);
+    double relative = expected != 0 ? error / fabs(expected) : error;
+    if (relative > worst_error) worst_error = relative;
+    if (approx ? error > alpha * fabs(expected) + 0.5 : error != 0) {
+      printf("Quantile %g: got %.0f, expected %.0f\n", quantiles[q],
+             round(answers[q]), expected);
+      ok = false;
+    }
+  }
+  if (approx) printf("Worst relative error: %g\n", worst_error);
+  free(sorted);
+  return ok;
+}
+
+// Parses a comma-separated list of quantiles in [0, 1].
+static int ParseQuantiles(const char *list, double *quantiles) {
+  int count = 0;
+  const char *p = list;
+  while (*p != '\0') {
+    char *end;
+    double q = strtod(p, &end);
+    if (end == p || q < 0 || q > 1 || count == MAX_QUANTILES) return -1;
+    quantiles[count++] = q;
+    if (*end == ',') end++;
+    else if (*end != '\0') return -1;
+    p = end;
+  }
+  return count;
+}
+
+int main(int argc, char **argv) {
+  uint32_t threads_num = 0;
+  uint32_t array_size = 0;
+  uint32_t seed = 0;
+  double quantiles[MAX_QUANTILES];
+  int quantiles_num = ParseQuantiles(DEFAULT_QUANTILES, quantiles);
+  bool approx = false;
+  double alpha = DEFAULT_ALPHA;
+  bool verify = false;
+
+  static struct option options[] = {
+    {"threads_num", required_argument, 0, 0},
+    {"array_size", required_argument, 0, 0},
+    {"seed", required_argument, 0, 0},
+    {"quantiles", required_argument, 0, 0},
+    {"approx", no_argument, 0, 0},
+    {"alpha", required_argument, 0, 0},
+    {"verify", no_argument, 0, 0},
+    {0, 0, 0, 0}
+  };
+
+  int option_index = 0;
+  while (1 == 1) {
+    int c = getopt_long(argc, argv, "", options, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+      case 0:
+        switch (option_index) {
+          case 0:
+            threads_num = atoi(optarg);
+            if (threads_num <= 0) {
+              printf("threads_num must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 1:
+            array_size = atoi(optarg);
+            if (array_size <= 0) {
+              printf("array_size must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 2:
+            seed = atoi(optarg);
+            if (seed <= 0) {
+              printf("seed must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 3:
+            quantiles_num = ParseQuantiles(optarg, quantiles);
+            if (quantiles_num <= 0) {
+              printf("quantiles must be up to %d comma-separated numbers in [0, 1]\n",
+                     MAX_QUANTILES);
+              return 1;
+            }
+            break;
+          case 4:
+            approx = true;
+            break;
+          case 5:
+            alpha = atof(optarg);
+            if (alpha <= 0 || alpha >= 1) {
+              printf("alpha must be between 0 and 1\n");
+              return 1;
+            }
+            break;
+          case 6:
+            verify = true;
+            break;
+          default:
+            printf("Index %d is out of options\n", option_index);
+        }
+        break;
+      case '?':
+        break;
+      default:
+        printf("getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  if (threads_num == 0 || array_size == 0 || seed == 0) {
+    printf("Usage: %s --threads_num \"num\" --array_size \"num\" --seed \"num\" [--quantiles \"q,q,...\"] [--approx [--alpha \"num\"]] [--verify]\n",
+           argv[0]);
+    return 1;
+  }
+
+  int *array = malloc(sizeof(int) * array_size);
+  GenerateArray(array, array_size, seed);
+
+  struct QuantileSlot *slots = aligned_alloc(
+      CACHE_LINE_SIZE, sizeof(struct QuantileSlot) * threads_num);
+  unsigned int segment_size = array_size / threads_num;
+  for (uint32_t i = 0; i < threads_num; i++) {
+    memset(&slots[i], 0, sizeof(slots[i]));
+    slots[i].array = array;
+    slots[i].begin = i * segment_size;
+    slots[i].end = (i == threads_num - 1) ? array_size : (i + 1) * segment_size;
+  }
+
+  double answers[MAX_QUANTILES];
+  double start_time = MonotonicMs();
+  size_t memory =
+      approx ? ApproxQuantiles(slots, threads_num, alpha, quantiles,
+                               quantiles_num, answers)
+             : ExactQuantiles(slots, threads_num, array_size, quantiles,
+                              quantiles_num, answers);
+  double elapsed_time = MonotonicMs() - start_time;
+
+  for (int q = 0; q < quantiles_num; q++) {
+    printf("Quantile %g: %.0f\n", quantiles[q], round(answers[q]));
+  }
+  printf("Method: %s\n", approx ? "sketch" : "radix select");
+  printf("Working memory: %zu KiB\n", memory >> 10);
+  printf("Elapsed time: %fms\n", elapsed_time);
+
+  int status = 0;
+  if (verify) {
+    bool ok = VerifyQuantiles(array, array_size, quantiles, quantiles_num,
+                              answers, approx, alpha);
+    printf("Verify: %s\n", ok ? "OK" : "MISMATCH");
+    status = ok ? 0 : 1;
+  }
+
+  free(slots);
+  free(array);
+  return status;
+}
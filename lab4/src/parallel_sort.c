@@ -0,0 +1,177 @@
+// parallel_sort.c
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "affinity.h"
+#include "alloc.h"
+#include "sort.h"
+#include "utils.h"
+
+// Order-independent fingerprint of the values, to check the sort only
+// moved them around.
+struct Fingerprint {
+  uint64_t sum;
+  uint64_t mix;
+};
+
+static struct Fingerprint TakeFingerprint(const int *array,
+                                          unsigned int array_size) {
+  struct Fingerprint print = {0, 0};
+  for (unsigned int i = 0; i < array_size; i++) {
+    print.sum += (uint32_t)array[i];
+    print.mix ^= (uint64_t)(uint32_t)array[i] * 0x9E3779B97F4A7C15ull;
+  }
+  return print;
+}
+
+// Index of the first value smaller than the one before it, or array_size
+// when the array is ordered.
+static unsigned int FindDisorder(const int *array, unsigned int array_size) {
+  for (unsigned int i = 1; i < array_size; i++) {
+    if (array[i] < array[i - 1]) return i;
+  }
+  return array_size;
+}
+
+int main(int argc, char **argv) {
+  uint32_t threads_num = 0;
+  uint32_t array_size = 0;
+  uint32_t seed = 0;
+  enum SortAlgorithm algorithm = SORT_AUTO;
+  struct Placement placement = {PIN_NONE, false, NULL, 0, 1};
+  enum PageBacking backing = PAGES_DEFAULT;
+
+  static struct option options[] = {
+    {"threads_num", required_argument, 0, 0},
+    {"array_size", required_argument, 0, 0},
+    {"seed", required_argument, 0, 0},
+    {"algorithm", required_argument, 0, 0},
+    {"pin", required_argument, 0, 0},
+    {"pages", required_argument, 0, 0},
+    {0, 0, 0, 0}
+  };
+
+  int option_index = 0;
+  while (1 == 1) {
+    int c = getopt_long(argc, argv, "", options, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+      case 0:
+        switch (option_index) {
+          case 0:
+            threads_num = atoi(optarg);
+            if (threads_num <= 0) {
+              printf("threads_num must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 1:
+            array_size = atoi(optarg);
+            if (array_size <= 0) {
+              printf("array_size must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 2:
+            seed = atoi(optarg);
+            if (seed <= 0) {
+              printf("seed must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 3:
+            if (!ParseSortAlgorithm(optarg, &algorithm)) {
+              printf("algorithm must be auto, radix or merge\n");
+              return 1;
+            }
+            break;
+          case 4:
+            if (!ParsePinPolicy(optarg, &placement.policy)) {
+              printf("pin must be none, compact or scatter\n");
+              return 1;
+            }
+            break;
+          case 5:
+            if (!ParsePageBacking(optarg, &backing)) {
+              printf("pages must be default, thp or hugetlb\n");
+              return 1;
+            }
+            break;
+          default:
+            printf("Index %d is out of options\n", option_index);
+        }
+        break;
+      case '?':
+        break;
+      default:
+        printf("getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  if (threads_num == 0 || array_size == 0 || seed == 0) {
+    printf("Usage: %s --threads_num \"num\" --array_size \"num\" --seed \"num\" [--algorithm auto|radix|merge] [--pin none|compact|scatter] [--pages default|thp|hugetlb]\n",
+           argv[0]);
+    return 1;
+  }
+  if (!BuildPlacement(&placement)) {
+    printf("Could not read the CPU topology\n");
+    return 1;
+  }
+
+  // Both sorts move every value between the array and an equally large
+  // scratch buffer, so the two get the same backing.
+  struct ArrayAllocation allocation = {0};
+  struct ArrayAllocation scratch_allocation = {0};
+  int *array = AllocateArray(sizeof(int) * array_size, backing, false,
+                             &allocation);
+  int *scratch = AllocateArray(sizeof(int) * array_size, backing, false,
+                               &scratch_allocation);
+  if (array == NULL || scratch == NULL) {
+    printf("Array allocation failed!\n");
+    return 1;
+  }
+  GenerateArray(array, array_size, seed);
+  struct Fingerprint before = TakeFingerprint(array, array_size);
+
+  double start_time = MonotonicMs();
+  enum SortAlgorithm used = ParallelSort(array, scratch, array_size,
+                                         threads_num, algorithm, &placement);
+  double elapsed_time = MonotonicMs() - start_time;
+
+  unsigned int disorder = FindDisorder(array, array_size);
+  struct Fingerprint after = TakeFingerprint(array, array_size);
+  bool same = before.sum == after.sum && before.mix == after.mix;
+
+  printf("Algorithm: %s\n", SortAlgorithmName(used));
+  printf("Elapsed time: %fms\n", elapsed_time);
+  printf("Throughput: %.0f elements/s\n",
+         elapsed_time > 0 ? array_size / (elapsed_time / 1000) : 0);
+  if (placement.policy != PIN_NONE)
+    PrintPlacement(&placement, threads_num);
+  if (backing != PAGES_DEFAULT) {
+    MeasureAllocation(&allocation);
+    PrintAllocation(&allocation);
+  }
+
+  int status = 0;
+  if (disorder != array_size) {
+    printf("Verify: NOT ORDERED at index %u (%d after %d)\n", disorder,
+           array[disorder], array[disorder - 1]);
+    status = 1;
+  } else if (!same) {
+    printf("Verify: MISMATCH, the values changed\n");
+    status = 1;
+  } else {
+    printf("Verify: OK\n");
+  }
+
+  FreeArray(&scratch_allocation);
+  FreeArray(&allocation);
+  FreePlacement(&placement);
+  return status;
+}
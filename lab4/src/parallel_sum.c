@@ -1,31 +1,97 @@
 // parallel_sum.c
+#include <inttypes.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <sys/time.h>
+#include <sys/mman.h>
 
 #include <pthread.h>
 
+#include "affinity.h"
+#include "alloc.h"
+#include "input.h"
 #include "utils.h"
 #include "sum.h"
 
+// Slots are cache-line aligned, so no two threads share a line and
+// writing a result does not invalidate a line a neighbour is still
+// reading its arguments from.
+struct SumSlot {
+  struct SumArgs args;
+  // Set for int64 --input files, which are summed from here instead of
+  // args.array. Kept in 128 bits for their sake.
+  const int64_t *array64;
+  __int128 sum;
+  // NULL unless the array is a mapped --input file.
+  const struct MappedInput *input;
+  // NULL unless --timing was given.
+  struct WorkerTiming *timing;
+  // -1 when the thread is not pinned.
+  int cpu;
+  // Set with --numa: generate the segment before summing it.
+  bool first_touch;
+  unsigned int seed;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
 void *ThreadSum(void *args) {
-  struct SumArgs *sum_args = (struct SumArgs *)args;
-  return (void *)(size_t)Sum(sum_args);
+  struct SumSlot *slot = (struct SumSlot *)args;
+  PinSelf(slot->cpu);
+  if (slot->timing)
+    BeginWorkerTiming(slot->timing);
+  if (slot->first_touch)
+    GenerateArrayRange(slot->args.array, slot->args.begin, slot->args.end,
+                       slot->seed);
+  PrefetchInput(slot->input, slot->args.begin, slot->args.end);
+  if (slot->array64 != NULL) {
+    slot->sum = SumInt64(slot->array64, slot->args.begin, slot->args.end);
+  } else {
+    slot->sum = Sum(&slot->args);
+  }
+  if (slot->timing)
+    EndWorkerTiming(slot->timing);
+  return NULL;
+}
+
+// printf has no conversion for __int128.
+static void PrintInt128(__int128 value) {
+  char digits[48];
+  int length = 0;
+  unsigned __int128 magnitude = value < 0 ? -(unsigned __int128)value
+                                        : (unsigned __int128)value;
+  do {
+    digits[length++] = '0' + (int)(magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0) putchar('-');
+  while (length > 0) putchar(digits[--length]);
 }
 
 int main(int argc, char **argv) {
   uint32_t threads_num = 0;
   uint32_t array_size = 0;
   uint32_t seed = 0;
-  
+  bool timing = false;
+  struct Placement placement = {PIN_NONE, false, NULL, 0, 1};
+  const char *input_path = NULL;
+  enum ElementType input_type = ELEMENT_INT32;
+  enum PageBacking backing = PAGES_DEFAULT;
+  bool prefault = false;
+
   static struct option options[] = {
     {"threads_num", required_argument, 0, 0},
     {"array_size", required_argument, 0, 0},
     {"seed", required_argument, 0, 0},
+    {"timing", no_argument, 0, 0},
+    {"pin", required_argument, 0, 0},
+    {"numa", no_argument, 0, 0},
+    {"input", required_argument, 0, 0},
+    {"input_type", required_argument, 0, 0},
+    {"pages", required_argument, 0, 0},
+    {"prefault", no_argument, 0, 0},
     {0, 0, 0, 0}
   };
 
@@ -58,6 +124,36 @@ int main(int argc, char **argv) {
               return 1;
             }
             break;
+          case 3:
+            timing = true;
+            break;
+          case 4:
+            if (!ParsePinPolicy(optarg, &placement.policy)) {
+              printf("pin must be none, compact or scatter\n");
+              return 1;
+            }
+            break;
+          case 5:
+            placement.first_touch = true;
+            break;
+          case 6:
+            input_path = optarg;
+            break;
+          case 7:
+            if (!ParseElementType(optarg, &input_type)) {
+              printf("input_type must be int32 or int64\n");
+              return 1;
+            }
+            break;
+          case 8:
+            if (!ParsePageBacking(optarg, &backing)) {
+              printf("pages must be default, thp or hugetlb\n");
+              return 1;
+            }
+            break;
+          case 9:
+            prefault = true;
+            break;
           default:
             printf("Index %d is out of options\n", option_index);
         }
@@ -69,51 +165,136 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (threads_num == 0 || array_size == 0 || seed == 0) {
-    printf("Usage: %s --threads_num \"num\" --array_size \"num\" --seed \"num\"\n",
-           argv[0]);
+  // A mapped --input replaces the generated array; --array_size then
+  // optionally limits the run to a prefix of the file.
+  if (threads_num == 0 ||
+      (input_path == NULL && (array_size == 0 || seed == 0))) {
+    printf("Usage: %s --threads_num \"num\" --array_size \"num\" --seed \"num\" [--timing] [--pin none|compact|scatter] [--numa] [--pages default|thp|hugetlb] [--prefault]\n"
+           "       %s --threads_num \"num\" --input \"path\" [--input_type int32|int64] [--array_size \"num\"] [...]\n",
+           argv[0], argv[0]);
+    return 1;
+  }
+  if (input_path != NULL && placement.first_touch) {
+    printf("--numa generates the array in place and cannot be used with --input\n");
+    return 1;
+  }
+  if (prefault && placement.first_touch) {
+    printf("--prefault would touch the array before the --numa workers do\n");
+    return 1;
+  }
+
+  // --numa without an explicit policy spreads threads over the nodes.
+  if (placement.first_touch && placement.policy == PIN_NONE) {
+    placement.policy = PIN_SCATTER;
+  }
+  if (!BuildPlacement(&placement)) {
+    printf("Could not read the CPU topology\n");
     return 1;
   }
 
-  int *array = malloc(sizeof(int) * array_size);
-  GenerateArray(array, array_size, seed);
+  struct PhaseTiming phases = {0};
+  double phase_start = MonotonicMs();
+  struct MappedInput input = {NULL, 0, 0, input_type};
+  struct ArrayAllocation allocation = {0};
+  int *array = NULL;
+  if (input_path != NULL) {
+    if (!MapInput(input_path, input_type, &input)) {
+      return 1;
+    }
+    if (input.count > INT_MAX) {
+      printf("%s: %zu elements, at most %d are supported\n", input_path,
+             input.count, INT_MAX);
+      return 1;
+    }
+    if (array_size == 0 || array_size > input.count) {
+      array_size = input.count;
+    }
+    if (input_type == ELEMENT_INT32) {
+      array = (int *)input.data;
+    }
+  } else {
+    // Without --prefault the pages stay untouched until first written,
+    // which --numa relies on.
+    array = AllocateArray(sizeof(int) * array_size, backing, prefault,
+                          &allocation);
+    if (array == NULL) {
+      printf("Array allocation failed!\n");
+      return 1;
+    }
+  }
+  phases.alloc_ms = MonotonicMs() - phase_start;
+
+  if (input_path == NULL && !placement.first_touch) {
+    phase_start = MonotonicMs();
+    GenerateArray(array, array_size, seed);
+    phases.generate_ms = MonotonicMs() - phase_start;
+  }
 
   pthread_t threads[threads_num];
-  struct SumArgs args[threads_num];
+  struct SumSlot slots[threads_num];
+  struct WorkerTiming timings[threads_num];
+  memset(timings, 0, sizeof(timings));
 
   int segment_size = array_size / threads_num;
   for (uint32_t i = 0; i < threads_num; i++) {
-    args[i].array = array;
-    args[i].begin = i * segment_size;
-    args[i].end = (i == threads_num - 1) ? array_size : (i + 1) * segment_size;
+    slots[i].args.array = array;
+    slots[i].args.begin = i * segment_size;
+    slots[i].args.end = (i == threads_num - 1) ? array_size : (i + 1) * segment_size;
+    slots[i].timing = timing ? &timings[i] : NULL;
+    slots[i].cpu = PlacementCpu(&placement, i);
+    slots[i].first_touch = placement.first_touch;
+    slots[i].seed = seed;
+    slots[i].input = input_path != NULL ? &input : NULL;
+    slots[i].array64 = input_type == ELEMENT_INT64 ? input.data : NULL;
   }
 
-  struct timeval start_time;
-  gettimeofday(&start_time, NULL);
-
+  double start_time = MonotonicMs();
   for (uint32_t i = 0; i < threads_num; i++) {
-    if (pthread_create(&threads[i], NULL, ThreadSum, (void *)&args[i])) {
+    if (pthread_create(&threads[i], NULL, ThreadSum, (void *)&slots[i])) {
       printf("Error: pthread_create failed!\n");
-      free(array);
       return 1;
     }
   }
+  phases.spawn_ms = MonotonicMs() - start_time;
 
-  int total_sum = 0;
+  __int128 total_sum = 0;
   for (uint32_t i = 0; i < threads_num; i++) {
-    int sum = 0;
-    pthread_join(threads[i], (void **)&sum);
-    total_sum += sum;
+    pthread_join(threads[i], NULL);
+    total_sum += slots[i].sum;
   }
+  if (timing)
+    phases.reduce_ms = MonotonicMs() - LastWorkerEnd(timings, threads_num);
 
-  struct timeval finish_time;
-  gettimeofday(&finish_time, NULL);
+  double elapsed_time = MonotonicMs() - start_time;
 
-  double elapsed_time = (finish_time.tv_sec - start_time.tv_sec) * 1000.0;
-  elapsed_time += (finish_time.tv_usec - start_time.tv_usec) / 1000.0;
+  bool report_pages = input_path == NULL &&
+                      (backing != PAGES_DEFAULT || prefault);
+  if (report_pages) {
+    MeasureAllocation(&allocation);
+  }
 
-  free(array);
-  printf("Total: %d\n", total_sum);
+  phase_start = MonotonicMs();
+  if (input_path != NULL) {
+    UnmapInput(&input);
+  } else {
+    FreeArray(&allocation);
+  }
+  phases.teardown_ms = MonotonicMs() - phase_start;
+  printf("Total: ");
+  PrintInt128(total_sum);
+  printf("\n");
+  // int64 --input files go through the plain SumInt64 loop, not the
+  // dispatched kernels.
+  printf("Kernel: %s\n", input_type == ELEMENT_INT64
+                              ? "int64-scalar"
+                              : SumImplName(GetSumImpl()));
   printf("Elapsed time: %fms\n", elapsed_time);
+  if (placement.policy != PIN_NONE)
+    PrintPlacement(&placement, threads_num);
+  if (report_pages)
+    PrintAllocation(&allocation);
+  FreePlacement(&placement);
+  if (timing)
+    PrintTiming(&phases, timings, threads_num, start_time, "thread");
   return 0;
 }
\ No newline at end of file
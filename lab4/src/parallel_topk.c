@@ -0,0 +1,183 @@
+// parallel_topk.c
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <pthread.h>
+
+#include "order_stats.h"
+#include "utils.h"
+
+// Values printed in full; longer answers are abbreviated.
+#define PRINT_LIMIT 16
+
+struct TopKSlot {
+  int *array;
+  unsigned int begin;
+  unsigned int end;
+  struct TopK top;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+void *ThreadTopK(void *args) {
+  struct TopKSlot *slot = (struct TopKSlot *)args;
+  TopKScan(&slot->top, slot->array, slot->begin, slot->end);
+  return NULL;
+}
+
+static int CompareInts(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+// Checks the answer against a full sort of a copy of the array.
+static bool VerifyTopK(const int *array, unsigned int array_size,
+                       const int *answer, int k, bool largest) {
+  int *sorted = malloc(sizeof(int) * array_size);
+  memcpy(sorted, array, sizeof(int) * array_size);
+  double start = MonotonicMs();
+  qsort(sorted, array_size, sizeof(int), CompareInts);
+  printf("Full sort: %fms\n", MonotonicMs() - start);
+
+  bool ok = true;
+  for (int i = 0; i < k && ok; i++) {
+    int expected = largest ? sorted[array_size - 1 - i] : sorted[i];
+    ok = answer[i] == expected;
+  }
+  free(sorted);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t threads_num = 0;
+  uint32_t array_size = 0;
+  uint32_t seed = 0;
+  int k = 0;
+  bool largest = false;
+  bool verify = false;
+
+  static struct option options[] = {
+    {"threads_num", required_argument, 0, 0},
+    {"array_size", required_argument, 0, 0},
+    {"seed", required_argument, 0, 0},
+    {"k", required_argument, 0, 0},
+    {"largest", no_argument, 0, 0},
+    {"verify", no_argument, 0, 0},
+    {0, 0, 0, 0}
+  };
+
+  int option_index = 0;
+  while (1 == 1) {
+    int c = getopt_long(argc, argv, "", options, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+      case 0:
+        switch (option_index) {
+          case 0:
+            threads_num = atoi(optarg);
+            if (threads_num <= 0) {
+              printf("threads_num must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 1:
+            array_size = atoi(optarg);
+            if (array_size <= 0) {
+              printf("array_size must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 2:
+            seed = atoi(optarg);
+            if (seed <= 0) {
+              printf("seed must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 3:
+            k = atoi(optarg);
+            if (k <= 0) {
+              printf("k must be a positive number\n");
+              return 1;
+            }
+            break;
+          case 4:
+            largest = true;
+            break;
+          case 5:
+            verify = true;
+            break;
+          default:
+            printf("Index %d is out of options\n", option_index);
+        }
+        break;
+      case '?':
+        break;
+      default:
+        printf("getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  if (threads_num == 0 || array_size == 0 || seed == 0 || k == 0) {
+    printf("Usage: %s --threads_num \"num\" --array_size \"num\" --seed \"num\" --k \"num\" [--largest] [--verify]\n",
+           argv[0]);
+    return 1;
+  }
+  if ((uint32_t)k > array_size) k = array_size;
+
+  int *array = malloc(sizeof(int) * array_size);
+  GenerateArray(array, array_size, seed);
+
+  pthread_t threads[threads_num];
+  struct TopKSlot *slots =
+      aligned_alloc(CACHE_LINE_SIZE, sizeof(struct TopKSlot) * threads_num);
+  unsigned int segment_size = array_size / threads_num;
+
+  double start_time = MonotonicMs();
+  for (uint32_t i = 0; i < threads_num; i++) {
+    slots[i].array = array;
+    slots[i].begin = i * segment_size;
+    slots[i].end = (i == threads_num - 1) ? array_size : (i + 1) * segment_size;
+    TopKInit(&slots[i].top, k, largest);
+    if (pthread_create(&threads[i], NULL, ThreadTopK, &slots[i])) {
+      printf("Error: pthread_create failed!\n");
+      return 1;
+    }
+  }
+
+  // Each worker kept at most k candidates; the answer is the best k of
+  // their union.
+  struct TopK top;
+  TopKInit(&top, k, largest);
+  for (uint32_t i = 0; i < threads_num; i++) {
+    pthread_join(threads[i], NULL);
+    TopKMerge(&top, &slots[i].top);
+    TopKFree(&slots[i].top);
+  }
+  int *answer = malloc(sizeof(int) * k);
+  int found = TopKSorted(&top, answer);
+  double elapsed_time = MonotonicMs() - start_time;
+
+  printf("%s %d:", largest ? "Largest" : "Smallest", found);
+  for (int i = 0; i < found && i < PRINT_LIMIT; i++) {
+    printf(" %d", answer[i]);
+  }
+  printf("%s\n", found > PRINT_LIMIT ? " ..." : "");
+  printf("Elapsed time: %fms\n", elapsed_time);
+
+  int status = 0;
+  if (verify) {
+    bool ok = VerifyTopK(array, array_size, answer, found, largest);
+    printf("Verify: %s\n", ok ? "OK" : "MISMATCH");
+    status = ok ? 0 : 1;
+  }
+
+  TopKFree(&top);
+  free(answer);
+  free(slots);
+  free(array);
+  return status;
+}
@@ -0,0 +1,304 @@
+#include "sort.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "utils.h"
+
+// LSD radix sort over 8-bit digits: four passes, each counting digits per
+// worker, turning the counts into scatter offsets, then scattering. 256
+// buckets keep every worker's write streams within the L1 and TLB.
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+
+// Runs of this many are insertion sorted before any merging.
+#define INSERTION_RUN 32
+// Segments are sorted in blocks of this many ints first (64 KiB, plus as
+// much scratch), so all the short merge passes of a block stay in L2 and
+// only the passes above it go to memory.
+#define MERGE_BLOCK (1u << 14)
+
+static const char *algorithm_names[] = {"auto", "radix", "merge"};
+
+bool ParseSortAlgorithm(const char *name, enum SortAlgorithm *algorithm) {
+  for (int i = SORT_AUTO; i <= SORT_MERGE; i++) {
+    if (strcmp(name, algorithm_names[i]) == 0) {
+      *algorithm = (enum SortAlgorithm)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *SortAlgorithmName(enum SortAlgorithm algorithm) {
+  return algorithm_names[algorithm];
+}
+
+struct SortTeam {
+  int *array;
+  int *scratch;
+  unsigned int size;
+  int threads_num;
+  const struct Placement *placement;
+  pthread_barrier_t barrier;
+  // Radix only: counts[worker * RADIX_SIZE + digit], rewritten in place
+  // into that worker's scatter offsets.
+  uint32_t *counts;
+  // Set when every value shares the current digit, so the pass is a no-op.
+  bool skip;
+};
+
+struct SortWorker {
+  struct SortTeam *team;
+  int index;
+  enum SortAlgorithm algorithm;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Start of segment i of threads_num; segment threads_num starts at size.
+static unsigned int SegmentBegin(const struct SortTeam *team, int i) {
+  return (uint64_t)team->size * i / team->threads_num;
+}
+
+// Flipping the sign bit orders ints as unsigned keys.
+static inline uint32_t RadixKey(int value) {
+  return (uint32_t)value ^ 0x80000000u;
+}
+
+// Exclusive prefix over (digit, worker), so each worker scatters its
+// values for a digit right after those of lower-numbered workers.
+static void RadixOffsets(struct SortTeam *team) {
+  uint32_t offset = 0;
+  team->skip = false;
+  for (int d = 0; d < RADIX_SIZE; d++) {
+    uint32_t total = 0;
+    for (int t = 0; t < team->threads_num; t++) {
+      uint32_t *count = &team->counts[(size_t)t * RADIX_SIZE + d];
+      uint32_t c = *count;
+      *count = offset;
+      offset += c;
+      total += c;
+    }
+    if (total == team->size) team->skip = true;
+  }
+}
+
+static void RadixWorker(struct SortTeam *team, int index) {
+  unsigned int begin = SegmentBegin(team, index);
+  unsigned int end = SegmentBegin(team, index + 1);
+  uint32_t *counts = team->counts + (size_t)index * RADIX_SIZE;
+  int *src = team->array;
+  int *dst = team->scratch;
+
+  for (int pass = 0; pass < RADIX_PASSES; pass++) {
+    int shift = pass * RADIX_BITS;
+    memset(counts, 0, sizeof(uint32_t) * RADIX_SIZE);
+    for (unsigned int i = begin; i < end; i++) {
+      counts[(RadixKey(src[i]) >> shift) & (RADIX_SIZE - 1)]++;
+    }
+    if (pthread_barrier_wait(&team->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+      RadixOffsets(team);
+    pthread_barrier_wait(&team->barrier);
+    if (team->skip) continue;
+
+    for (unsigned int i = begin; i < end; i++) {
+      int value = src[i];
+      dst[counts[(RadixKey(value) >> shift) & (RADIX_SIZE - 1)]++] = value;
+    }
+    int *swap = src;
+    src = dst;
+    dst = swap;
+    // Nobody may count the next digit until every value has moved.
+    pthread_barrier_wait(&team->barrier);
+  }
+
+  if (src != team->array)
+    memcpy(team->array + begin, src + begin, sizeof(int) * (end - begin));
+}
+
+static void InsertionSort(int *a, unsigned int n) {
+  for (unsigned int i = 1; i < n; i++) {
+    int value = a[i];
+    unsigned int j = i;
+    while (j > 0 && a[j - 1] > value) {
+      a[j] = a[j - 1];
+      j--;
+    }
+    a[j] = value;
+  }
+}
+
+// Branch-free on the comparison, which is unpredictable on random data.
+static void Merge(const int *a, unsigned int na, const int *b,
+                  unsigned int nb, int *out) {
+  unsigned int i = 0, j = 0, k = 0;
+  while (i < na && j < nb) {
+    int take_b = b[j] < a[i];
+    out[k++] = take_b ? b[j] : a[i];
+    j += take_b;
+    i += !take_b;
+  }
+  memcpy(out + k, a + i, sizeof(int) * (na - i));
+  memcpy(out + k + (na - i), b + j, sizeof(int) * (nb - j));
+}
+
+// Bottom-up merges of the sorted runs of width in a[0, n), using tmp as
+// the other buffer; the result ends up in a.
+static void MergePasses(int *a, int *tmp, unsigned int n, unsigned int width) {
+  int *src = a;
+  int *dst = tmp;
+  for (unsigned int w = width; w < n; w *= 2) {
+    for (unsigned int lo = 0; lo < n; lo += 2 * w) {
+      unsigned int mid = lo + w < n ? lo + w : n;
+      unsigned int hi = mid + w < n ? mid + w : n;
+      Merge(src + lo, mid - lo, src + mid, hi - mid, dst + lo);
+    }
+    int *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != a) memcpy(a, src, sizeof(int) * n);
+}
+
+static void SortSegment(int *a, int *tmp, unsigned int n) {
+  for (unsigned int block = 0; block < n; block += MERGE_BLOCK) {
+    unsigned int block_size = n - block < MERGE_BLOCK ? n - block : MERGE_BLOCK;
+    for (unsigned int run = 0; run < block_size; run += INSERTION_RUN) {
+      unsigned int run_size =
+          block_size - run < INSERTION_RUN ? block_size - run : INSERTION_RUN;
+      InsertionSort(a + block + run, run_size);
+    }
+    MergePasses(a + block, tmp + block, block_size, INSERTION_RUN);
+  }
+  MergePasses(a, tmp, n, MERGE_BLOCK);
+}
+
+// How many of a[0, na) are among the first k values of the merge of a and
+// b, taking from a first on ties as Merge does.
+static unsigned int CoRank(unsigned int k, const int *a, unsigned int na,
+                           const int *b, unsigned int nb) {
+  unsigned int lo = k > nb ? k - nb : 0;
+  unsigned int hi = k < na ? k : na;
+  while (lo < hi) {
+    unsigned int i = lo + (hi - lo) / 2;
+    unsigned int j = k - i;
+    if (j > 0 && b[j - 1] >= a[i]) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+  return lo;
+}
+
+// Writes piece of pieces equal parts of the merge of a and b to out, so
+// several workers can share one large merge.
+static void MergePiece(const int *a, unsigned int na, const int *b,
+                       unsigned int nb, int *out, int piece, int pieces) {
+  uint64_t n = (uint64_t)na + nb;
+  unsigned int k0 = n * piece / pieces;
+  unsigned int k1 = n * (piece + 1) / pieces;
+  unsigned int i0 = CoRank(k0, a, na, b, nb);
+  unsigned int i1 = CoRank(k1, a, na, b, nb);
+  Merge(a + i0, i1 - i0, b + (k0 - i0), (k1 - i1) - (k0 - i0), out + k0);
+}
+
+// Every worker sorts its own segment, then runs are merged pairwise until
+// one is left. Each round has half as many merges as the last, so the
+// workers split each merge into pieces instead of leaving most of them
+// idle.
+static void MergeWorker(struct SortTeam *team, int index) {
+  int threads_num = team->threads_num;
+  unsigned int begin = SegmentBegin(team, index);
+  unsigned int end = SegmentBegin(team, index + 1);
+  SortSegment(team->array + begin, team->scratch + begin, end - begin);
+
+  int *src = team->array;
+  int *dst = team->scratch;
+  for (int width = 1; width < threads_num; width *= 2) {
+    pthread_barrier_wait(&team->barrier);
+    // Merge g joins the runs starting at segments 2g * width and
+    // (2g + 1) * width, and gets workers [g * T / groups,
+    // (g + 1) * T / groups).
+    int groups = (threads_num + 2 * width - 1) / (2 * width);
+    int group = 0;
+    while ((int64_t)(group + 1) * threads_num / groups <= index) group++;
+    int first = (int64_t)group * threads_num / groups;
+    int pieces = (int64_t)(group + 1) * threads_num / groups - first;
+
+    int left = group * 2 * width;
+    int right = left + width < threads_num ? left + width : threads_num;
+    int last = right + width < threads_num ? right + width : threads_num;
+    unsigned int lo = SegmentBegin(team, left);
+    unsigned int mid = SegmentBegin(team, right);
+    unsigned int hi = SegmentBegin(team, last);
+    MergePiece(src + lo, mid - lo, src + mid, hi - mid, dst + lo,
+               index - first, pieces);
+
+    int *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != team->array) {
+    // The last round's pieces do not line up with the segments.
+    pthread_barrier_wait(&team->barrier);
+    memcpy(team->array + begin, src + begin, sizeof(int) * (end - begin));
+  }
+}
+
+void *ThreadSort(void *args) {
+  struct SortWorker *worker = (struct SortWorker *)args;
+  struct SortTeam *team = worker->team;
+  PinSelf(PlacementCpu(team->placement, worker->index));
+  if (worker->algorithm == SORT_RADIX) {
+    RadixWorker(team, worker->index);
+  } else {
+    MergeWorker(team, worker->index);
+  }
+  return NULL;
+}
+
+enum SortAlgorithm ParallelSort(int *array, int *scratch,
+                                unsigned int array_size, int threads_num,
+                                enum SortAlgorithm algorithm,
+                                const struct Placement *placement) {
+  if (algorithm == SORT_AUTO)
+    algorithm = array_size < SORT_RADIX_MIN_SIZE ? SORT_MERGE : SORT_RADIX;
+
+  struct SortTeam team = {.array = array,
+                          .scratch = scratch,
+                          .size = array_size,
+                          .threads_num = threads_num,
+                          .placement = placement};
+  if (algorithm == SORT_RADIX)
+    team.counts = malloc(sizeof(uint32_t) * RADIX_SIZE * threads_num);
+  pthread_barrier_init(&team.barrier, NULL, threads_num);
+
+  pthread_t threads[threads_num];
+  struct SortWorker *workers =
+      aligned_alloc(CACHE_LINE_SIZE, sizeof(struct SortWorker) * threads_num);
+  for (int i = 0; i < threads_num; i++) {
+    workers[i].team = &team;
+    workers[i].index = i;
+    workers[i].algorithm = algorithm;
+    // The team waits on a barrier sized for every worker, so a missing
+    // one would hang the rest.
+    if (pthread_create(&threads[i], NULL, ThreadSort, &workers[i])) {
+      printf("Error: pthread_create failed!\n");
+      exit(1);
+    }
+  }
+  for (int i = 0; i < threads_num; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_barrier_destroy(&team.barrier);
+  free(workers);
+  free(team.counts);
+  return algorithm;
+}
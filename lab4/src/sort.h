@@ -0,0 +1,26 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stdbool.h>
+
+#include "affinity.h"
+
+// auto picks merge sort below SORT_RADIX_MIN_SIZE, where the radix passes'
+// fixed cost of 256 buckets per thread per digit dominates, and the
+// radix sort above it.
+enum SortAlgorithm { SORT_AUTO, SORT_RADIX, SORT_MERGE };
+
+#define SORT_RADIX_MIN_SIZE (1u << 16)
+
+bool ParseSortAlgorithm(const char *name, enum SortAlgorithm *algorithm);
+const char *SortAlgorithmName(enum SortAlgorithm algorithm);
+
+// Sorts array ascending on threads_num threads, pinned according to
+// placement. scratch must hold array_size ints; the result always ends
+// up in array. Returns the algorithm actually used.
+enum SortAlgorithm ParallelSort(int *array, int *scratch,
+                                unsigned int array_size, int threads_num,
+                                enum SortAlgorithm algorithm,
+                                const struct Placement *placement);
+
+#endif
@@ -1,9 +1,148 @@
 #include "sum.h"
 
-int Sum(const struct SumArgs *args) {
-  int sum = 0;
-  for (int i = args->begin; i < args->end; i++) {
-    sum += args->array[i];
+#include <immintrin.h>
+
+typedef int64_t (*SumKernel)(const int *array, int begin, int end);
+
+// Four independent chains so the adds do not serialize on one register.
+static int64_t SumScalar(const int *array, int begin, int end) {
+  int64_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+  int i = begin;
+  for (; end - i >= 4; i += 4) {
+    sum0 += array[i];
+    sum1 += array[i + 1];
+    sum2 += array[i + 2];
+    sum3 += array[i + 3];
+  }
+  for (; i < end; i++) {
+    sum0 += array[i];
+  }
+  return sum0 + sum1 + sum2 + sum3;
+}
+
+__attribute__((target("sse4.1")))
+static int64_t SumSSE41(const int *array, int begin, int end) {
+  __m128i sum0 = _mm_setzero_si128(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+  int i = begin;
+  for (; end - i >= 8; i += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(array + i));
+    __m128i hi = _mm_loadu_si128((const __m128i *)(array + i + 4));
+    sum0 = _mm_add_epi64(sum0, _mm_cvtepi32_epi64(lo));
+    sum1 = _mm_add_epi64(sum1, _mm_cvtepi32_epi64(_mm_srli_si128(lo, 8)));
+    sum2 = _mm_add_epi64(sum2, _mm_cvtepi32_epi64(hi));
+    sum3 = _mm_add_epi64(sum3, _mm_cvtepi32_epi64(_mm_srli_si128(hi, 8)));
+  }
+  __m128i sum = _mm_add_epi64(_mm_add_epi64(sum0, sum1),
+                              _mm_add_epi64(sum2, sum3));
+  int64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, sum);
+  return lanes[0] + lanes[1] + SumScalar(array, i, end);
+}
+
+__attribute__((target("avx2")))
+static int64_t SumAVX2(const int *array, int begin, int end) {
+  __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+  int i = begin;
+  for (; end - i >= 16; i += 16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(array + i));
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(array + i + 4));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(array + i + 8));
+    __m128i v3 = _mm_loadu_si128((const __m128i *)(array + i + 12));
+    sum0 = _mm256_add_epi64(sum0, _mm256_cvtepi32_epi64(v0));
+    sum1 = _mm256_add_epi64(sum1, _mm256_cvtepi32_epi64(v1));
+    sum2 = _mm256_add_epi64(sum2, _mm256_cvtepi32_epi64(v2));
+    sum3 = _mm256_add_epi64(sum3, _mm256_cvtepi32_epi64(v3));
+  }
+  __m256i sum = _mm256_add_epi64(_mm256_add_epi64(sum0, sum1),
+                                 _mm256_add_epi64(sum2, sum3));
+  int64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + SumScalar(array, i, end);
+}
+
+__attribute__((target("avx512f")))
+static int64_t SumAVX512(const int *array, int begin, int end) {
+  __m512i sum0 = _mm512_setzero_si512(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+  int i = begin;
+  for (; end - i >= 32; i += 32) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(array + i));
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(array + i + 8));
+    __m256i v2 = _mm256_loadu_si256((const __m256i *)(array + i + 16));
+    __m256i v3 = _mm256_loadu_si256((const __m256i *)(array + i + 24));
+    sum0 = _mm512_add_epi64(sum0, _mm512_cvtepi32_epi64(v0));
+    sum1 = _mm512_add_epi64(sum1, _mm512_cvtepi32_epi64(v1));
+    sum2 = _mm512_add_epi64(sum2, _mm512_cvtepi32_epi64(v2));
+    sum3 = _mm512_add_epi64(sum3, _mm512_cvtepi32_epi64(v3));
+  }
+  __m512i sum = _mm512_add_epi64(_mm512_add_epi64(sum0, sum1),
+                                 _mm512_add_epi64(sum2, sum3));
+  return _mm512_reduce_add_epi64(sum) + SumScalar(array, i, end);
+}
+
+static const SumKernel kernels[SUM_IMPL_COUNT] = {
+    [SUM_SCALAR] = SumScalar,
+    [SUM_SSE41] = SumSSE41,
+    [SUM_AVX2] = SumAVX2,
+    [SUM_AVX512] = SumAVX512,
+};
+
+static const char *kernel_names[SUM_IMPL_COUNT] = {
+    [SUM_SCALAR] = "scalar",
+    [SUM_SSE41] = "sse4.1",
+    [SUM_AVX2] = "avx2",
+    [SUM_AVX512] = "avx512",
+};
+
+static enum SumImpl selected_impl = SUM_SCALAR;
+
+__attribute__((constructor))
+static void SelectSumImpl(void) {
+  for (int impl = SUM_IMPL_COUNT - 1; impl > SUM_SCALAR; impl--) {
+    if (SumImplSupported(impl)) {
+      selected_impl = impl;
+      return;
+    }
+  }
+}
+
+bool SumImplSupported(enum SumImpl impl) {
+  __builtin_cpu_init();
+  switch (impl) {
+    case SUM_SCALAR:
+      return true;
+    case SUM_SSE41:
+      return __builtin_cpu_supports("sse4.1");
+    case SUM_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case SUM_AVX512:
+      return __builtin_cpu_supports("avx512f");
+    default:
+      return false;
+  }
+}
+
+enum SumImpl GetSumImpl(void) { return selected_impl; }
+
+const char *SumImplName(enum SumImpl impl) {
+  if (impl < 0 || impl >= SUM_IMPL_COUNT) return "unknown";
+  return kernel_names[impl];
+}
+
+int64_t SumWith(enum SumImpl impl, const struct SumArgs *args) {
+  return kernels[impl](args->array, args->begin, args->end);
+}
+
+int64_t Sum(const struct SumArgs *args) {
+  return kernels[selected_impl](args->array, args->begin, args->end);
+}
+
+__int128 SumInt64(const int64_t *array, size_t begin, size_t end) {
+  __int128 sum0 = 0, sum1 = 0;
+  size_t i = begin;
+  for (; i + 2 <= end; i += 2) {
+    sum0 += array[i];
+    sum1 += array[i + 1];
   }
-  return sum;
-}
\ No newline at end of file
+  if (i < end) sum0 += array[i];
+  return sum0 + sum1;
+}
@@ -1,9 +1,39 @@
+#ifndef SUM_H
 #define SUM_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 struct SumArgs {
   int *array;
   int begin;
   int end;
 };
 
-int Sum(const struct SumArgs *args);
\ No newline at end of file
+// Sum kernels, from slowest to fastest. The fastest one the CPU supports is
+// picked once at startup.
+enum SumImpl {
+  SUM_SCALAR,
+  SUM_SSE41,
+  SUM_AVX2,
+  SUM_AVX512,
+  SUM_IMPL_COUNT
+};
+
+// Accumulates in 64 bits, so the result does not overflow for any int array
+// shorter than 2^32 elements.
+int64_t Sum(const struct SumArgs *args);
+
+// Runs a specific kernel; impl must be supported by the CPU.
+int64_t SumWith(enum SumImpl impl, const struct SumArgs *args);
+
+bool SumImplSupported(enum SumImpl impl);
+enum SumImpl GetSumImpl(void);
+const char *SumImplName(enum SumImpl impl);
+
+// Sum of int64 elements from a mapped --input file. It accumulates in 128
+// bits, since even a few int64 values can overflow 64.
+__int128 SumInt64(const int64_t *array, size_t begin, size_t end);
+
+#endif
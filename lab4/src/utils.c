@@ -1,10 +1,155 @@
+#define _GNU_SOURCE  // RUSAGE_THREAD
+
 #include "utils.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+
+#include <pthread.h>
+
+// Below this size spawning threads costs more than generating the array.
+#define PARALLEL_GENERATE_MIN_SIZE (1u << 20)
+
+struct GenerateArgs {
+  int *array;
+  unsigned int begin;
+  unsigned int end;
+  unsigned int seed;
+};
+
+// splitmix64 finalizer: a bijective mix of the 64-bit input.
+static uint64_t Mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Element i depends only on (seed, i), so any partition of the index range
+// produces the same array.
+static int GenerateElement(uint64_t key, uint64_t i) {
+  return (int)(Mix64(key + (i + 1) * 0x9E3779B97F4A7C15ULL) >> 33);
+}
+
+void GenerateArrayRange(int *array, unsigned int begin, unsigned int end,
+                        unsigned int seed) {
+  uint64_t key = Mix64(seed);
+  for (unsigned int i = begin; i < end; i++) {
+    array[i] = GenerateElement(key, i);
+  }
+}
+
+static void *ThreadGenerate(void *args) {
+  struct GenerateArgs *gen_args = (struct GenerateArgs *)args;
+  GenerateArrayRange(gen_args->array, gen_args->begin, gen_args->end,
+                     gen_args->seed);
+  return NULL;
+}
+
+void GenerateArrayParallel(int *array, unsigned int array_size,
+                           unsigned int seed, unsigned int threads_num) {
+  if (threads_num <= 1 || array_size < PARALLEL_GENERATE_MIN_SIZE) {
+    GenerateArrayRange(array, 0, array_size, seed);
+    return;
+  }
+
+  pthread_t threads[threads_num];
+  struct GenerateArgs args[threads_num];
+  unsigned int segment_size = array_size / threads_num;
+  unsigned int started = 0;
+
+  for (unsigned int i = 0; i < threads_num; i++) {
+    args[i].array = array;
+    args[i].begin = i * segment_size;
+    args[i].end = (i == threads_num - 1) ? array_size : (i + 1) * segment_size;
+    args[i].seed = seed;
+    if (pthread_create(&threads[i], NULL, ThreadGenerate, &args[i])) {
+      // Fill whatever the missing threads would have covered ourselves.
+      GenerateArrayRange(array, args[i].begin, array_size, seed);
+      break;
+    }
+    started++;
+  }
+
+  for (unsigned int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
 void GenerateArray(int *array, unsigned int array_size, unsigned int seed) {
-  srand(seed);
-  for (int i = 0; i < array_size; i++) {
-    array[i] = rand();
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  GenerateArrayParallel(array, array_size, seed, cpus > 0 ? cpus : 1);
+}
+
+static double TimespecMs(const struct timespec *ts) {
+  return ts->tv_sec * 1000.0 + ts->tv_nsec / 1e6;
+}
+
+double MonotonicMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return TimespecMs(&ts);
+}
+
+static double ThreadCpuMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return TimespecMs(&ts);
+}
+
+static long ThreadMinorFaults(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) != 0)
+    return 0;
+  return usage.ru_minflt;
+}
+
+void BeginWorkerTiming(struct WorkerTiming *timing) {
+  timing->finished = false;
+  timing->minor_faults = ThreadMinorFaults();
+  timing->cpu_ms = ThreadCpuMs();
+  timing->start_ms = MonotonicMs();
+}
+
+void EndWorkerTiming(struct WorkerTiming *timing) {
+  timing->end_ms = MonotonicMs();
+  timing->cpu_ms = ThreadCpuMs() - timing->cpu_ms;
+  timing->minor_faults = ThreadMinorFaults() - timing->minor_faults;
+  timing->finished = true;
+}
+
+double LastWorkerEnd(const struct WorkerTiming *timings, int workers_num) {
+  double last = 0;
+  for (int i = 0; i < workers_num; i++) {
+    if (timings[i].finished && timings[i].end_ms > last)
+      last = timings[i].end_ms;
+  }
+  return last;
+}
+
+void PrintTiming(const struct PhaseTiming *phases,
+                 const struct WorkerTiming *timings, int workers_num,
+                 double spawn_start_ms, const char *worker_name) {
+  printf("Timing (ms):\n");
+  printf("  alloc     %10.3f\n", phases->alloc_ms);
+  printf("  generate  %10.3f\n", phases->generate_ms);
+  printf("  spawn     %10.3f\n", phases->spawn_ms);
+  for (int i = 0; i < workers_num; i++) {
+    const struct WorkerTiming *timing = &timings[i];
+    if (!timing->finished) {
+      printf("  %s %d: did not finish\n", worker_name, i);
+      continue;
+    }
+    printf("  %s %d: started +%.3f, compute %.3f wall, %.3f cpu, "
+           "%ld minor faults\n",
+           worker_name, i, timing->start_ms - spawn_start_ms,
+           timing->end_ms - timing->start_ms, timing->cpu_ms,
+           timing->minor_faults);
   }
+  printf("  reduce    %10.3f\n", phases->reduce_ms);
+  printf("  teardown  %10.3f\n", phases->teardown_ms);
 }
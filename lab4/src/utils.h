@@ -1,11 +1,55 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdbool.h>
+
+#define CACHE_LINE_SIZE 64
+
 struct MinMax {
   int min;
   int max;
 };
 
+// Fills the array with non-negative pseudo-random numbers derived from
+// (seed, index) only, so the result is identical for any thread count.
+// GenerateArray uses one thread per online CPU.
 void GenerateArray(int *array, unsigned int array_size, unsigned int seed);
+void GenerateArrayParallel(int *array, unsigned int array_size,
+                           unsigned int seed, unsigned int threads_num);
+void GenerateArrayRange(int *array, unsigned int begin, unsigned int end,
+                        unsigned int seed);
+
+// --timing support. Times are in milliseconds; start and end are
+// CLOCK_MONOTONIC readings, so they compare across processes, and cpu is
+// the worker's own CLOCK_THREAD_CPUTIME_ID time. A worker whose wall time
+// is well above its CPU time was waiting: for the scheduler, for page
+// faults (counted in minor_faults) or for memory.
+struct WorkerTiming {
+  double start_ms;
+  double end_ms;
+  double cpu_ms;
+  long minor_faults;
+  bool finished;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// Wall time of the phases around the workers. reduce runs from the last
+// worker finishing to the merged result.
+struct PhaseTiming {
+  double alloc_ms;
+  double generate_ms;
+  double spawn_ms;
+  double reduce_ms;
+  double teardown_ms;
+};
+
+double MonotonicMs(void);
+// Called by a worker on itself, around its share of the work.
+void BeginWorkerTiming(struct WorkerTiming *timing);
+void EndWorkerTiming(struct WorkerTiming *timing);
+// Latest end_ms among the finished workers, or 0 if none finished.
+double LastWorkerEnd(const struct WorkerTiming *timings, int workers_num);
+void PrintTiming(const struct PhaseTiming *phases,
+                 const struct WorkerTiming *timings, int workers_num,
+                 double spawn_start_ms, const char *worker_name);
 
 #endif
@@ -0,0 +1,146 @@
+#include "block_index.h"
+
+#include <stdlib.h>
+
+#include "common.h"
+
+#define PAGE_BYTES (sizeof(uint64_t) * BLOCK_INDEX_PAGE_BLOCKS)
+
+void BlockIndexCacheInit(struct BlockIndexCache *cache, uint64_t block_size,
+                         uint64_t budget_bytes) {
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->head = NULL;
+  cache->block_size = block_size;
+  cache->budget_bytes = budget_bytes;
+  cache->used_bytes = 0;
+  cache->tick = 0;
+}
+
+static void FreeIndex(struct BlockIndexCache *cache, struct BlockIndex *index) {
+  for (uint64_t i = 0; i < index->pages_num; i++)
+    free(index->pages[i]);
+  cache->used_bytes -= index->pages_used * PAGE_BYTES +
+                      index->pages_num * sizeof(uint64_t *);
+  free(index->pages);
+  free(index);
+}
+
+// Drops least recently used idle indexes until need more bytes fit.
+// Called with the lock held.
+static void EvictLocked(struct BlockIndexCache *cache, uint64_t need) {
+  while (cache->used_bytes + need > cache->budget_bytes) {
+    struct BlockIndex **victim = NULL;
+    for (struct BlockIndex **it = &cache->head; *it; it = &(*it)->next) {
+      if ((*it)->refs == 0 &&
+          (!victim || (*it)->last_used < (*victim)->last_used))
+        victim = it;
+    }
+    if (!victim)
+      return;
+    struct BlockIndex *index = *victim;
+    *victim = index->next;
+    FreeIndex(cache, index);
+  }
+}
+
+struct BlockIndex *BlockIndexAcquire(struct BlockIndexCache *cache,
+                                     uint64_t mod) {
+  pthread_mutex_lock(&cache->lock);
+
+  struct BlockIndex *index = cache->head;
+  while (index && index->mod != mod)
+    index = index->next;
+
+  if (!index) {
+    // A single index may cover the whole budget; its page directory is
+    // charged against the budget as well.
+    uint64_t blocks = cache->budget_bytes / sizeof(uint64_t);
+    uint64_t pages_num = blocks / BLOCK_INDEX_PAGE_BLOCKS;
+    EvictLocked(cache, pages_num * sizeof(uint64_t *));
+
+    index = calloc(1, sizeof(struct BlockIndex));
+    index->mod = mod;
+    index->pages_num = pages_num;
+    index->pages = calloc(pages_num ? pages_num : 1, sizeof(uint64_t *));
+    cache->used_bytes += pages_num * sizeof(uint64_t *);
+    index->next = cache->head;
+    cache->head = index;
+  }
+
+  index->refs++;
+  index->last_used = ++cache->tick;
+  pthread_mutex_unlock(&cache->lock);
+  return index;
+}
+
+void BlockIndexRelease(struct BlockIndexCache *cache,
+                       struct BlockIndex *index) {
+  pthread_mutex_lock(&cache->lock);
+  index->refs--;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// Entries hold product + 1 so that 0 means "not computed yet"; product is
+// below mod <= UINT64_MAX, so the sum never wraps.
+static uint64_t *BlockSlot(struct BlockIndexCache *cache,
+                           struct BlockIndex *index, uint64_t block,
+                           bool allocate) {
+  uint64_t page = block / BLOCK_INDEX_PAGE_BLOCKS;
+  if (page >= index->pages_num)
+    return NULL;
+
+  uint64_t *entries = __atomic_load_n(&index->pages[page], __ATOMIC_ACQUIRE);
+  if (!entries && allocate) {
+    pthread_mutex_lock(&cache->lock);
+    entries = index->pages[page];
+    if (!entries) {
+      EvictLocked(cache, PAGE_BYTES);
+      if (cache->used_bytes + PAGE_BYTES <= cache->budget_bytes) {
+        entries = calloc(BLOCK_INDEX_PAGE_BLOCKS, sizeof(uint64_t));
+        cache->used_bytes += PAGE_BYTES;
+        index->pages_used++;
+        __atomic_store_n(&index->pages[page], entries, __ATOMIC_RELEASE);
+      }
+    }
+    pthread_mutex_unlock(&cache->lock);
+  }
+  return entries ? &entries[block % BLOCK_INDEX_PAGE_BLOCKS] : NULL;
+}
+
+static uint64_t BlockProduct(struct BlockIndexCache *cache,
+                             struct BlockIndex *index, uint64_t block) {
+  const uint64_t block_size = cache->block_size;
+  uint64_t *slot = BlockSlot(cache, index, block, false);
+  if (slot) {
+    uint64_t stored = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (stored)
+      return stored - 1;
+  }
+
+  uint64_t product = MultRangeModulo(block * block_size + 1,
+                                     (block + 1) * block_size, index->mod);
+  if (!slot)
+    slot = BlockSlot(cache, index, block, true);
+  if (slot)
+    __atomic_store_n(slot, product + 1, __ATOMIC_RELAXED);
+  return product;
+}
+
+uint64_t BlockIndexRangeProduct(struct BlockIndexCache *cache,
+                                struct BlockIndex *index, uint64_t begin,
+                                uint64_t end) {
+  const uint64_t block_size = cache->block_size;
+  const uint64_t mod = index->mod;
+
+  // Full blocks are first..last; the edges around them are multiplied out.
+  uint64_t first = (begin - 1 + block_size - 1) / block_size;
+  uint64_t last_end = end / block_size;
+  if (first >= last_end)
+    return MultRangeModulo(begin, end, mod);
+
+  uint64_t ans = MultRangeModulo(begin, first * block_size, mod);
+  for (uint64_t block = first; block < last_end; block++)
+    ans = MultModulo(ans, BlockProduct(cache, index, block), mod);
+  return MultModulo(ans, MultRangeModulo(last_end * block_size + 1, end, mod),
+                    mod);
+}
@@ -0,0 +1,50 @@
+#ifndef BLOCK_INDEX_H
+#define BLOCK_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Block j covers [j * B + 1, (j + 1) * B]. Products are kept in pages of
+// this many blocks that are only allocated once something is stored there.
+#define BLOCK_INDEX_PAGE_BLOCKS 512
+
+// Products of every B consecutive integers modulo one modulus, filled in
+// lazily as ranges are queried.
+struct BlockIndex {
+  uint64_t mod;
+  uint64_t **pages;
+  uint64_t pages_num;
+  uint64_t pages_used;
+  int refs;
+  uint64_t last_used;
+  struct BlockIndex *next;
+};
+
+// All indexes together stay within budget_bytes; the least recently used
+// idle index is evicted when a new page would not fit.
+struct BlockIndexCache {
+  pthread_mutex_t lock;
+  struct BlockIndex *head;
+  uint64_t block_size;
+  uint64_t budget_bytes;
+  uint64_t used_bytes;
+  uint64_t tick;
+};
+
+void BlockIndexCacheInit(struct BlockIndexCache *cache, uint64_t block_size,
+                         uint64_t budget_bytes);
+// Returns the index for mod, creating it if needed. The index stays alive
+// until released.
+struct BlockIndex *BlockIndexAcquire(struct BlockIndexCache *cache,
+                                     uint64_t mod);
+void BlockIndexRelease(struct BlockIndexCache *cache, struct BlockIndex *index);
+
+// prod[begin, end] mod index->mod in O(B + (end - begin) / B) once the
+// blocks involved are stored; missing blocks are computed and stored.
+// Requires 1 <= begin <= end.
+uint64_t BlockIndexRangeProduct(struct BlockIndexCache *cache,
+                                struct BlockIndex *index, uint64_t begin,
+                                uint64_t end);
+
+#endif
@@ -9,19 +9,305 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include "pthread.h"
 #include "common.h"
+#include "protocol.h"
 
+#define DEFAULT_PIPELINE_DEPTH 8
+#define DEFAULT_CHUNK_MS 50
+#define DEFAULT_MIN_CHUNK 1024
+
+#define DEFAULT_TIMEOUT_MS 10000
+// How often an idle connection looks for ranges worth hedging.
+#define HEDGE_POLL_MS 5
+// Per-number service times kept for the hedging percentile.
+#define LATENCY_SAMPLES 256
+
+// One chunk of [1, k]. A chunk has at most two holders at a time: the
+// server it was handed to and, once hedged, a second one. The first
+// answer is multiplied into the product, the other is dropped.
+struct Piece {
+  uint64_t begin;
+  uint64_t end;
+  // When the primary holder sent it.
+  double sent;
+  int holders[2];
+  bool done;
+};
+
+// Hands out [1, k] in chunks on demand, so every server pulls work as fast
+// as it completes it instead of owning a fixed share. Chunks lost with a
+// failed server are queued for retry and handed to the next server that
+// asks, so the product is either complete or reported as an error.
+struct Scheduler {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  // Becomes readable once every piece is done, so connections still
+  // waiting on hedged duplicates stop polling their sockets.
+  int finished_fd;
+  uint64_t next;
+  uint64_t k;
+  uint64_t mod;
+  uint64_t min_chunk;
+  int servers_num;
+
+  struct Piece *pieces;
+  size_t pieces_num;
+  size_t pieces_capacity;
+  size_t pieces_done;
+  // Every piece before this one is done; hedging scans from here.
+  size_t first_open;
+  size_t *retry;
+  size_t retry_num;
+  uint64_t product;
+
+  // 0 disables hedging. Otherwise a piece is also sent to a second server
+  // once it has been out for longer than this percentile of the observed
+  // per-number latency times its length.
+  double hedge_pct;
+  double samples[LATENCY_SAMPLES];
+  unsigned samples_num;
+  double hedge_unit;
+};
+
+// Every server gets one thread and one persistent connection, with up to
+// pipeline_depth chunks in flight.
 struct ThreadArgs {
+  int id;
   struct Server server;
+  struct Scheduler *scheduler;
+  int pipeline_depth;
+  double chunk_seconds;
+  double timeout;
+  bool failed;
+  uint64_t chunks_done;
+  uint64_t numbers_done;
+  uint64_t hedges_sent;
+  uint64_t hedges_won;
+};
+
+// The range is copied out of the scheduler, since pieces may be
+// reallocated by other threads.
+struct InFlight {
+  size_t piece;
   uint64_t begin;
   uint64_t end;
-  uint64_t mod;
-  uint64_t result;
+  bool hedge;
+  bool used;
+  uint64_t id;
+  double sent;
 };
 
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool SchedulerFinished(const struct Scheduler *scheduler) {
+  return scheduler->next > scheduler->k &&
+         scheduler->pieces_done == scheduler->pieces_num;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static size_t NewPiece(struct Scheduler *scheduler, uint64_t begin,
+                       uint64_t end) {
+  if (scheduler->pieces_num == scheduler->pieces_capacity) {
+    scheduler->pieces_capacity = scheduler->pieces_capacity * 2 + 64;
+    scheduler->pieces = realloc(scheduler->pieces,
+                                sizeof(struct Piece) * scheduler->pieces_capacity);
+    scheduler->retry = realloc(scheduler->retry,
+                               sizeof(size_t) * scheduler->pieces_capacity);
+  }
+  struct Piece *piece = &scheduler->pieces[scheduler->pieces_num];
+  piece->begin = begin;
+  piece->end = end;
+  piece->sent = 0;
+  piece->holders[0] = -1;
+  piece->holders[1] = -1;
+  piece->done = false;
+  return scheduler->pieces_num++;
+}
+
+static bool HoldPiece(struct Piece *piece, int holder) {
+  for (int i = 0; i < 2; i++) {
+    if (piece->holders[i] < 0) {
+      piece->holders[i] = holder;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the only holder of a piece, or -1 if it has none or two.
+static int SoleHolder(const struct Piece *piece) {
+  if ((piece->holders[0] < 0) == (piece->holders[1] < 0))
+    return -1;
+  return piece->holders[0] >= 0 ? piece->holders[0] : piece->holders[1];
+}
+
+static void DropHolder(struct Piece *piece, int holder) {
+  for (int i = 0; i < 2; i++) {
+    if (piece->holders[i] == holder) {
+      piece->holders[i] = -1;
+      return;
+    }
+  }
+}
+
+// Hands out, in order of preference: a chunk lost with a failed server,
+// a fresh chunk of up to want numbers, or a hedge for a chunk whose
+// server is running late. Fresh chunks never exceed half of a fair share
+// of what is left, so the tail is spread over all servers.
+static bool ClaimPiece(struct Scheduler *scheduler, int holder, uint64_t want,
+                       struct InFlight *claimed) {
+  bool found = false;
+  double now = NowSeconds();
+  pthread_mutex_lock(&scheduler->lock);
+  if (scheduler->retry_num > 0) {
+    claimed->piece = scheduler->retry[--scheduler->retry_num];
+    claimed->hedge = false;
+    HoldPiece(&scheduler->pieces[claimed->piece], holder);
+    scheduler->pieces[claimed->piece].sent = now;
+    found = true;
+  } else if (scheduler->next <= scheduler->k) {
+    uint64_t left = scheduler->k - scheduler->next + 1;
+    uint64_t share = left / (2 * (uint64_t)scheduler->servers_num);
+    if (want > share)
+      want = share;
+    if (want < scheduler->min_chunk)
+      want = scheduler->min_chunk;
+    if (want > left)
+      want = left;
+
+    claimed->piece = NewPiece(scheduler, scheduler->next,
+                              scheduler->next + want - 1);
+    claimed->hedge = false;
+    HoldPiece(&scheduler->pieces[claimed->piece], holder);
+    scheduler->pieces[claimed->piece].sent = now;
+    scheduler->next += want;
+    found = true;
+  } else if (scheduler->hedge_unit > 0) {
+    for (size_t i = scheduler->first_open; i < scheduler->pieces_num; i++) {
+      struct Piece *piece = &scheduler->pieces[i];
+      int other = SoleHolder(piece);
+      if (piece->done || other < 0 || other == holder)
+        continue;
+      double length = piece->end - piece->begin + 1;
+      if (now - piece->sent < scheduler->hedge_unit * length)
+        continue;
+      HoldPiece(piece, holder);
+      claimed->piece = i;
+      claimed->hedge = true;
+      found = true;
+      break;
+    }
+  }
+  if (found) {
+    claimed->begin = scheduler->pieces[claimed->piece].begin;
+    claimed->end = scheduler->pieces[claimed->piece].end;
+  }
+  pthread_mutex_unlock(&scheduler->lock);
+  return found;
+}
+
+// Records a reply; returns true if it was the first one for the piece.
+static bool FinishPiece(struct Scheduler *scheduler, size_t index, int holder,
+                        uint64_t result, double latency) {
+  bool won = false;
+  pthread_mutex_lock(&scheduler->lock);
+  struct Piece *piece = &scheduler->pieces[index];
+  DropHolder(piece, holder);
+
+  if (scheduler->hedge_pct > 0) {
+    double length = piece->end - piece->begin + 1;
+    scheduler->samples[scheduler->samples_num++ % LATENCY_SAMPLES] =
+        latency / length;
+    // Re-derive the percentile every 32 samples, once there are enough.
+    if (scheduler->samples_num >= 32 && scheduler->samples_num % 32 == 0) {
+      unsigned count = scheduler->samples_num < LATENCY_SAMPLES
+                           ? scheduler->samples_num
+                           : LATENCY_SAMPLES;
+      double sorted[LATENCY_SAMPLES];
+      memcpy(sorted, scheduler->samples, sizeof(double) * count);
+      qsort(sorted, count, sizeof(double), CompareDoubles);
+      unsigned rank = (unsigned)(scheduler->hedge_pct / 100.0 * (count - 1));
+      scheduler->hedge_unit = sorted[rank];
+    }
+  }
+
+  if (!piece->done) {
+    piece->done = true;
+    scheduler->product = MultModulo(scheduler->product, result, scheduler->mod);
+    scheduler->pieces_done++;
+    while (scheduler->first_open < scheduler->pieces_num &&
+           scheduler->pieces[scheduler->first_open].done)
+      scheduler->first_open++;
+    won = true;
+    if (SchedulerFinished(scheduler)) {
+      uint64_t one = 1;
+      if (write(scheduler->finished_fd, &one, sizeof(one)) < 0)
+        perror("write");
+    }
+    pthread_cond_broadcast(&scheduler->changed);
+  }
+  pthread_mutex_unlock(&scheduler->lock);
+  return won;
+}
+
+// Gives up on everything a failed server held. Pieces nobody else is
+// working on go back to the retry queue.
+static void AbandonPieces(struct Scheduler *scheduler, int holder,
+                          const struct InFlight *in_flight, int depth) {
+  pthread_mutex_lock(&scheduler->lock);
+  for (int i = 0; i < depth; i++) {
+    if (!in_flight[i].used)
+      continue;
+    size_t index = in_flight[i].piece;
+    struct Piece *piece = &scheduler->pieces[index];
+    DropHolder(piece, holder);
+    if (!piece->done && piece->holders[0] < 0 && piece->holders[1] < 0)
+      scheduler->retry[scheduler->retry_num++] = index;
+  }
+  pthread_cond_broadcast(&scheduler->changed);
+  pthread_mutex_unlock(&scheduler->lock);
+}
+
+// Blocks an idle connection until there may be something to claim.
+// Returns false once every piece is done.
+static bool WaitForWork(struct Scheduler *scheduler) {
+  pthread_mutex_lock(&scheduler->lock);
+  if (scheduler->hedge_pct > 0) {
+    // Hedges become due with time, not with an event, so just nap.
+    if (!SchedulerFinished(scheduler) && scheduler->retry_num == 0) {
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += HEDGE_POLL_MS * 1000000L;
+      if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&scheduler->changed, &scheduler->lock, &until);
+    }
+  } else {
+    while (!SchedulerFinished(scheduler) && scheduler->retry_num == 0)
+      pthread_cond_wait(&scheduler->changed, &scheduler->lock);
+  }
+  bool more = !SchedulerFinished(scheduler);
+  pthread_mutex_unlock(&scheduler->lock);
+  return more;
+}
+
 int ReadServersFromFile(const char *filename, struct Server **servers) {
   FILE *file = fopen(filename, "r");
   if (!file) {
@@ -61,65 +347,241 @@ int ReadServersFromFile(const char *filename, struct Server **servers) {
   return count;
 }
 
-void *ServerThread(void *args) {
-  struct ThreadArgs *thread_args = (struct ThreadArgs *)args;
-  
-  struct hostent *hostname = gethostbyname(thread_args->server.ip);
+static bool SendAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+static int ConnectToServer(const struct Server *server) {
+  struct hostent *hostname = gethostbyname(server->ip);
   if (hostname == NULL) {
-    fprintf(stderr, "gethostbyname failed with %s\n", thread_args->server.ip);
-    thread_args->result = 1;
-    return NULL;
+    fprintf(stderr, "gethostbyname failed with %s\n", server->ip);
+    return -1;
   }
 
   struct sockaddr_in server_addr;
   server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(thread_args->server.port);
+  server_addr.sin_port = htons(server->port);
   server_addr.sin_addr.s_addr = *((unsigned long *)hostname->h_addr);
 
   int sockfd = socket(AF_INET, SOCK_STREAM, 0);
   if (sockfd < 0) {
     fprintf(stderr, "Socket creation failed!\n");
-    thread_args->result = 1;
-    return NULL;
+    return -1;
   }
 
   if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-    fprintf(stderr, "Connection to %s:%d failed\n", 
-            thread_args->server.ip, thread_args->server.port);
+    fprintf(stderr, "Connection to %s:%d failed\n", server->ip, server->port);
     close(sockfd);
-    thread_args->result = 1;
-    return NULL;
+    return -1;
   }
 
-  char task[sizeof(uint64_t) * 3];
-  memcpy(task, &thread_args->begin, sizeof(uint64_t));
-  memcpy(task + sizeof(uint64_t), &thread_args->end, sizeof(uint64_t));
-  memcpy(task + 2 * sizeof(uint64_t), &thread_args->mod, sizeof(uint64_t));
+  // Requests are small and already batched; don't let Nagle hold them.
+  int opt_val = 1;
+  setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &opt_val, sizeof(opt_val));
+  return sockfd;
+}
 
-  if (send(sockfd, task, sizeof(task), 0) < 0) {
-    fprintf(stderr, "Send to %s:%d failed\n", 
-            thread_args->server.ip, thread_args->server.port);
-    close(sockfd);
-    thread_args->result = 1;
-    return NULL;
+// Handles one complete frame. Returns false if the server broke the
+// protocol or reported an error.
+static bool HandleReply(struct ThreadArgs *thread_args, const char *frame,
+                        const struct FrameHeader *header,
+                        struct InFlight *in_flight, int *in_flight_num,
+                        double *rate, double *last_reply) {
+  const char *payload = frame + FRAME_HEADER_SIZE;
+  if (header->type == FRAME_ERROR) {
+    fprintf(stderr, "Server %s:%d rejected a request: %s\n",
+            thread_args->server.ip, thread_args->server.port,
+            ProtocolErrorName(DecodeErrorCode(payload)));
+    return false;
   }
 
-  char response[sizeof(uint64_t)];
-  if (recv(sockfd, response, sizeof(response), 0) < 0) {
-    fprintf(stderr, "Receive from %s:%d failed\n", 
+  struct InFlight *entry = NULL;
+  for (int i = 0; i < thread_args->pipeline_depth; i++) {
+    if (in_flight[i].used && in_flight[i].id == header->id) {
+      entry = &in_flight[i];
+      break;
+    }
+  }
+  if (header->type != FRAME_RESPONSE || header->count != 1 || !entry) {
+    fprintf(stderr, "Server %s:%d sent an unexpected frame\n",
             thread_args->server.ip, thread_args->server.port);
-    close(sockfd);
-    thread_args->result = 1;
+    return false;
+  }
+
+  uint64_t result;
+  DecodeResponseResults(payload, 1, &result);
+
+  uint64_t length = entry->end - entry->begin + 1;
+  double now = NowSeconds();
+  double elapsed = now - *last_reply;
+  if (elapsed > 1e-6) {
+    double sample = length / elapsed;
+    *rate = *rate == 0 ? sample : 0.7 * *rate + 0.3 * sample;
+  }
+  *last_reply = now;
+
+  if (FinishPiece(thread_args->scheduler, entry->piece, thread_args->id,
+                  result, now - entry->sent)) {
+    thread_args->chunks_done++;
+    thread_args->numbers_done += length;
+    if (entry->hedge)
+      thread_args->hedges_won++;
+  }
+  entry->used = false;
+  (*in_flight_num)--;
+  return true;
+}
+
+void *ServerThread(void *args) {
+  struct ThreadArgs *thread_args = (struct ThreadArgs *)args;
+  struct Scheduler *scheduler = thread_args->scheduler;
+  const int depth = thread_args->pipeline_depth;
+  const int id = thread_args->id;
+
+  int sockfd = ConnectToServer(&thread_args->server);
+  if (sockfd < 0) {
+    thread_args->failed = true;
     return NULL;
   }
 
-  memcpy(&thread_args->result, response, sizeof(uint64_t));
+  // Every chunk is its own single-tuple frame so replies can be matched
+  // to chunks one by one; the frames of a round go out in one send.
+  char *task = malloc((FRAME_HEADER_SIZE + FRAME_TUPLE_SIZE) * depth);
+  struct InFlight *in_flight = calloc(depth, sizeof(struct InFlight));
+  int in_flight_num = 0;
+  uint64_t next_id = 1;
+  char response[PROTOCOL_MAX_RESPONSE * 2];
+  size_t response_len = 0;
+
+  // Completion rate in numbers per second, smoothed over recent replies.
+  // Unknown until the first reply, so the first chunks are minimal.
+  double rate = 0;
+  double last_reply = NowSeconds();
+
+  while (!thread_args->failed) {
+    size_t task_len = 0;
+    for (int slot = 0; slot < depth && in_flight_num < depth; slot++) {
+      struct InFlight *entry = &in_flight[slot];
+      if (entry->used)
+        continue;
+      uint64_t want = (uint64_t)(rate * thread_args->chunk_seconds);
+      if (!ClaimPiece(scheduler, id, want, entry))
+        break;
+
+      if (in_flight_num == 0)
+        last_reply = NowSeconds();
+      entry->used = true;
+      entry->id = next_id++;
+      entry->sent = NowSeconds();
+      struct FactorialArgs item = {entry->begin, entry->end, scheduler->mod};
+      task_len += EncodeRequest(task + task_len, entry->id, &item, 1);
+      if (entry->hedge)
+        thread_args->hedges_sent++;
+      in_flight_num++;
+    }
+    if (task_len > 0 && !SendAll(sockfd, task, task_len)) {
+      fprintf(stderr, "Send to %s:%d failed\n",
+              thread_args->server.ip, thread_args->server.port);
+      thread_args->failed = true;
+      break;
+    }
+    if (in_flight_num == 0) {
+      if (!WaitForWork(scheduler))
+        break;
+      continue;
+    }
+
+    // The oldest request sets the deadline.
+    const struct InFlight *oldest = NULL;
+    for (int i = 0; i < depth; i++) {
+      if (in_flight[i].used && (!oldest || in_flight[i].sent < oldest->sent))
+        oldest = &in_flight[i];
+    }
+    double left = oldest->sent + thread_args->timeout - NowSeconds();
+    if (left <= 0) {
+      fprintf(stderr, "Server %s:%d missed the deadline for [%llu, %llu]\n",
+              thread_args->server.ip, thread_args->server.port,
+              oldest->begin, oldest->end);
+      thread_args->failed = true;
+      break;
+    }
+    int wait_ms = (int)(left * 1000) + 1;
+    if (scheduler->hedge_pct > 0 && in_flight_num < depth &&
+        wait_ms > HEDGE_POLL_MS)
+      wait_ms = HEDGE_POLL_MS;
+
+    struct pollfd pfds[2] = {{.fd = sockfd, .events = POLLIN},
+                             {.fd = scheduler->finished_fd, .events = POLLIN}};
+    int ready = poll(pfds, 2, wait_ms);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    // Whatever is still in flight was hedged and already answered.
+    if (pfds[1].revents & POLLIN)
+      break;
+    if (!(pfds[0].revents & (POLLIN | POLLERR | POLLHUP)))
+      continue;
+
+    ssize_t n = recv(sockfd, response + response_len,
+                     sizeof(response) - response_len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      fprintf(stderr, "Receive from %s:%d failed\n",
+              thread_args->server.ip, thread_args->server.port);
+      thread_args->failed = true;
+      break;
+    }
+    response_len += n;
+
+    size_t consumed = 0;
+    while (response_len - consumed >= FRAME_HEADER_SIZE) {
+      struct FrameHeader header;
+      enum ProtocolError error =
+          DecodeFrameHeader(response + consumed, &header);
+      if (error != PROTOCOL_OK) {
+        fprintf(stderr, "Server %s:%d sent a bad frame: %s\n",
+                thread_args->server.ip, thread_args->server.port,
+                ProtocolErrorName(error));
+        thread_args->failed = true;
+        break;
+      }
+      size_t frame_size = FRAME_HEADER_SIZE + header.length;
+      if (response_len - consumed < frame_size)
+        break;
+      if (!HandleReply(thread_args, response + consumed, &header, in_flight,
+                       &in_flight_num, &rate, &last_reply)) {
+        thread_args->failed = true;
+        break;
+      }
+      consumed += frame_size;
+    }
+    memmove(response, response + consumed, response_len - consumed);
+    response_len -= consumed;
+  }
+
+  if (thread_args->failed)
+    AbandonPieces(scheduler, id, in_flight, depth);
+  free(task);
+  free(in_flight);
   close(sockfd);
-  
-  printf("Server %s:%d returned: %llu for range [%llu, %llu]\n", 
+  if (thread_args->failed)
+    return NULL;
+
+  printf("Server %s:%d computed %llu numbers in %llu chunks "
+         "(%llu hedges sent, %llu won)\n",
          thread_args->server.ip, thread_args->server.port,
-         thread_args->result, thread_args->begin, thread_args->end);
-  
+         thread_args->numbers_done, thread_args->chunks_done,
+         thread_args->hedges_sent, thread_args->hedges_won);
+
   return NULL;
 }
 
@@ -127,6 +589,11 @@ int main(int argc, char **argv) {
   uint64_t k = -1;
   uint64_t mod = -1;
   char servers_file[255] = {'\0'};
+  int pipeline_depth = DEFAULT_PIPELINE_DEPTH;
+  int chunk_ms = DEFAULT_CHUNK_MS;
+  uint64_t min_chunk = DEFAULT_MIN_CHUNK;
+  int timeout_ms = DEFAULT_TIMEOUT_MS;
+  double hedge_pct = 0;
 
   while (true) {
     int current_optind = optind ? optind : 1;
@@ -134,6 +601,11 @@ int main(int argc, char **argv) {
     static struct option options[] = {{"k", required_argument, 0, 0},
                                       {"mod", required_argument, 0, 0},
                                       {"servers", required_argument, 0, 0},
+                                      {"pipeline", required_argument, 0, 0},
+                                      {"chunk_ms", required_argument, 0, 0},
+                                      {"min_chunk", required_argument, 0, 0},
+                                      {"timeout_ms", required_argument, 0, 0},
+                                      {"hedge_pct", required_argument, 0, 0},
                                       {0, 0, 0, 0}};
 
     int option_index = 0;
@@ -155,6 +627,40 @@ int main(int argc, char **argv) {
         strncpy(servers_file, optarg, sizeof(servers_file) - 1);
         servers_file[sizeof(servers_file) - 1] = '\0';
         break;
+      case 3:
+        pipeline_depth = atoi(optarg);
+        if (pipeline_depth <= 0) {
+          fprintf(stderr, "pipeline must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 4:
+        chunk_ms = atoi(optarg);
+        if (chunk_ms <= 0) {
+          fprintf(stderr, "chunk_ms must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 5:
+        if (!ConvertStringToUI64(optarg, &min_chunk) || min_chunk == 0) {
+          fprintf(stderr, "min_chunk must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 6:
+        timeout_ms = atoi(optarg);
+        if (timeout_ms <= 0) {
+          fprintf(stderr, "timeout_ms must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 7:
+        hedge_pct = atof(optarg);
+        if (hedge_pct < 0 || hedge_pct >= 100) {
+          fprintf(stderr, "hedge_pct must be in [0, 100)\n");
+          return 1;
+        }
+        break;
       default:
         printf("Index %d is out of options\n", option_index);
       }
@@ -169,7 +675,10 @@ int main(int argc, char **argv) {
   }
 
   if (k == -1 || mod == -1 || !strlen(servers_file)) {
-    fprintf(stderr, "Using: %s --k 1000 --mod 5 --servers /path/to/file\n",
+    fprintf(stderr,
+            "Using: %s --k 1000 --mod 5 --servers /path/to/file "
+            "[--pipeline 8] [--chunk_ms 50] [--min_chunk 1024] "
+            "[--timeout_ms 10000] [--hedge_pct 95]\n",
             argv[0]);
     return 1;
   }
@@ -183,44 +692,67 @@ int main(int argc, char **argv) {
 
   printf("Found %d servers\n", servers_num);
 
+  // Chunks are sized per server so each takes about chunk_ms to compute,
+  // based on that server's measured throughput.
+  struct Scheduler scheduler;
+  memset(&scheduler, 0, sizeof(scheduler));
+  pthread_mutex_init(&scheduler.lock, NULL);
+  pthread_cond_init(&scheduler.changed, NULL);
+  scheduler.finished_fd = eventfd(0, EFD_CLOEXEC);
+  if (scheduler.finished_fd < 0) {
+    perror("eventfd");
+    return 1;
+  }
+  scheduler.next = 1;
+  scheduler.k = k;
+  scheduler.mod = mod;
+  scheduler.min_chunk = min_chunk;
+  scheduler.servers_num = servers_num;
+  scheduler.product = 1 % mod;
+  scheduler.hedge_pct = hedge_pct;
+
   pthread_t threads[servers_num];
+  bool started[servers_num];
   struct ThreadArgs thread_args[servers_num];
-  
-  uint64_t range_size = k / servers_num;
-  uint64_t remainder = k % servers_num;
-  uint64_t current_start = 1;
 
   for (int i = 0; i < servers_num; i++) {
+    memset(&thread_args[i], 0, sizeof(thread_args[i]));
+    thread_args[i].id = i;
     thread_args[i].server = servers[i];
-    thread_args[i].mod = mod;
-    thread_args[i].begin = current_start;
-    
-    uint64_t range = range_size;
-    if (i < remainder) {
-      range++;
-    }
-    
-    thread_args[i].end = current_start + range - 1;
-    current_start += range;
-
-    printf("Server %d: %s:%d will compute [%llu, %llu]\n", 
-           i, servers[i].ip, servers[i].port, 
-           thread_args[i].begin, thread_args[i].end);
+    thread_args[i].scheduler = &scheduler;
+    thread_args[i].pipeline_depth = pipeline_depth;
+    thread_args[i].chunk_seconds = chunk_ms / 1000.0;
+    thread_args[i].timeout = timeout_ms / 1000.0;
 
-    if (pthread_create(&threads[i], NULL, ServerThread, &thread_args[i])) {
+    started[i] = !pthread_create(&threads[i], NULL, ServerThread,
+                                 &thread_args[i]);
+    if (!started[i]) {
       fprintf(stderr, "Error creating thread for server %d\n", i);
-      thread_args[i].result = 1;
     }
   }
 
-  uint64_t total_result = 1;
   for (int i = 0; i < servers_num; i++) {
-    pthread_join(threads[i], NULL);
-    total_result = MultModulo(total_result, thread_args[i].result, mod);
+    if (started[i])
+      pthread_join(threads[i], NULL);
   }
 
-  printf("\nFinal result: %llu! mod %llu = %llu\n", k, mod, total_result);
+  // A failed server's chunks are retried elsewhere, so the product is only
+  // short if every server failed before the work was done.
+  int status = 0;
+  if (!SchedulerFinished(&scheduler)) {
+    fprintf(stderr, "All servers failed before [1, %llu] was covered, "
+            "no result\n", k);
+    status = 1;
+  } else {
+    printf("\nFinal result: %llu! mod %llu = %llu\n", k, mod,
+           scheduler.product);
+  }
 
+  close(scheduler.finished_fd);
+  pthread_cond_destroy(&scheduler.changed);
+  pthread_mutex_destroy(&scheduler.lock);
+  free(scheduler.pieces);
+  free(scheduler.retry);
   free(servers);
-  return 0;
-}
\ No newline at end of file
+  return status;
+}
@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include "common.h"
 
-uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod) {
+uint64_t MultModuloReference(uint64_t a, uint64_t b, uint64_t mod) {
   uint64_t result = 0;
   a = a % mod;
   while (b > 0) {
@@ -13,6 +13,84 @@ uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod) {
   return result % mod;
 }
 
+uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod) {
+  return (uint64_t)((unsigned __int128)a * b % mod);
+}
+
+bool MontgomeryInit(struct Montgomery *mont, uint64_t mod) {
+  if (mod % 2 == 0 || mod == 1)
+    return false;
+
+  // Newton iteration: each step doubles the number of correct low bits of
+  // mod^-1 mod 2^64, starting from 3 bits (mod * mod == 1 mod 8).
+  uint64_t inv = mod;
+  for (int i = 0; i < 5; i++)
+    inv *= 2 - mod * inv;
+
+  mont->mod = mod;
+  mont->inv = inv;
+  mont->one = (uint64_t)(((unsigned __int128)1 << 64) % mod);
+  mont->r2 = MultModulo(mont->one, mont->one, mod);
+  return true;
+}
+
+// Returns t * 2^-64 mod m for t < m * 2^64. Subtracting instead of adding
+// q * mod keeps the intermediate within 128 bits for any odd 64-bit mod.
+static uint64_t MontgomeryReduce(const struct Montgomery *mont,
+                                 unsigned __int128 t) {
+  uint64_t q = (uint64_t)t * mont->inv;
+  uint64_t t_hi = (uint64_t)(t >> 64);
+  uint64_t qm_hi = (uint64_t)(((unsigned __int128)q * mont->mod) >> 64);
+  return t_hi >= qm_hi ? t_hi - qm_hi : t_hi - qm_hi + mont->mod;
+}
+
+uint64_t MontgomeryMul(const struct Montgomery *mont, uint64_t a, uint64_t b) {
+  return MontgomeryReduce(mont, (unsigned __int128)a * b);
+}
+
+uint64_t MontgomeryAdd(const struct Montgomery *mont, uint64_t a, uint64_t b) {
+  uint64_t sum = a + b;
+  if (sum < a || sum >= mont->mod)
+    sum -= mont->mod;
+  return sum;
+}
+
+uint64_t MontgomeryToForm(const struct Montgomery *mont, uint64_t a) {
+  return MontgomeryMul(mont, a % mont->mod, mont->r2);
+}
+
+uint64_t MontgomeryFromForm(const struct Montgomery *mont, uint64_t a) {
+  return MontgomeryReduce(mont, a);
+}
+
+uint64_t MultRangeModulo(uint64_t begin, uint64_t end, uint64_t mod) {
+  if (begin > end)
+    return 1 % mod;
+
+  struct Montgomery mont;
+  if (!MontgomeryInit(&mont, mod)) {
+    uint64_t ans = 1 % mod;
+    for (uint64_t i = begin;; i++) {
+      ans = MultModulo(ans, i, mod);
+      if (i == end)
+        break;
+    }
+    return ans;
+  }
+
+  // Keep both the product and the running factor in Montgomery form so
+  // every step is one multiply-reduce and one modular add.
+  uint64_t ans = mont.one;
+  uint64_t factor = MontgomeryToForm(&mont, begin);
+  for (uint64_t i = begin;; i++) {
+    ans = MontgomeryMul(&mont, ans, factor);
+    if (i == end)
+      break;
+    factor = MontgomeryAdd(&mont, factor, mont.one);
+  }
+  return MontgomeryFromForm(&mont, ans);
+}
+
 bool ConvertStringToUI64(const char *str, uint64_t *val) {
   char *end = NULL;
   unsigned long long i = strtoull(str, &end, 10);
@@ -26,4 +104,4 @@ bool ConvertStringToUI64(const char *str, uint64_t *val) {
 
   *val = i;
   return true;
-}
\ No newline at end of file
+}
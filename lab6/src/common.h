@@ -17,7 +17,30 @@ struct FactorialArgs {
   uint64_t mod;
 };
 
+// Montgomery context for a fixed odd modulus. Values "in form" are
+// a * 2^64 mod mod; products of such values stay in form.
+struct Montgomery {
+  uint64_t mod;
+  uint64_t inv; // mod^-1 mod 2^64
+  uint64_t one; // 2^64 mod mod, i.e. 1 in Montgomery form
+  uint64_t r2;  // 2^128 mod mod
+};
+
+// Shift-and-add multiplication, kept as the reference implementation.
+uint64_t MultModuloReference(uint64_t a, uint64_t b, uint64_t mod);
+// 128-bit multiply followed by one reduction.
 uint64_t MultModulo(uint64_t a, uint64_t b, uint64_t mod);
+
+// Fails for even moduli and mod == 1.
+bool MontgomeryInit(struct Montgomery *mont, uint64_t mod);
+uint64_t MontgomeryMul(const struct Montgomery *mont, uint64_t a, uint64_t b);
+uint64_t MontgomeryAdd(const struct Montgomery *mont, uint64_t a, uint64_t b);
+uint64_t MontgomeryToForm(const struct Montgomery *mont, uint64_t a);
+uint64_t MontgomeryFromForm(const struct Montgomery *mont, uint64_t a);
+
+// Product of all integers in [begin, end] modulo mod. Uses Montgomery
+// arithmetic for odd moduli.
+uint64_t MultRangeModulo(uint64_t begin, uint64_t end, uint64_t mod);
 bool ConvertStringToUI64(const char *str, uint64_t *val);
 
 #endif
\ No newline at end of file
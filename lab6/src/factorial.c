@@ -0,0 +1,340 @@
+#include "factorial.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+// Exact convolutions of residues below SUBLINEAR_MAX_MOD stay below
+// 2^107, so two ~2^62 NTT primes recover them through CRT.
+#define NTT_PRIME_1 4611685944339202049ULL // 0x3fffffee c0000001 = c * 2^30 + 1
+#define NTT_ROOT_1 3ULL
+#define NTT_PRIME_2 4611685917495656449ULL // 0x3fffffe8 80000001 = c * 2^31 + 1
+#define NTT_ROOT_2 11ULL
+
+static uint64_t PowModulo(uint64_t base, uint64_t exp, uint64_t mod) {
+  uint64_t result = 1 % mod;
+  base %= mod;
+  while (exp > 0) {
+    if (exp & 1)
+      result = MultModulo(result, base, mod);
+    base = MultModulo(base, base, mod);
+    exp >>= 1;
+  }
+  return result;
+}
+
+// Inverse modulo a prime through Fermat's little theorem.
+static uint64_t InvModulo(uint64_t a, uint64_t p) {
+  return PowModulo(a, p - 2, p);
+}
+
+bool IsPrime64(uint64_t n) {
+  static const uint64_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+  const size_t bases_num = sizeof(bases) / sizeof(bases[0]);
+
+  if (n < 2)
+    return false;
+  for (size_t i = 0; i < bases_num; i++) {
+    if (n % bases[i] == 0)
+      return n == bases[i];
+  }
+
+  uint64_t d = n - 1;
+  int s = 0;
+  while (d % 2 == 0) {
+    d /= 2;
+    s++;
+  }
+
+  for (size_t i = 0; i < bases_num; i++) {
+    uint64_t x = PowModulo(bases[i], d, n);
+    if (x == 1 || x == n - 1)
+      continue;
+    bool composite = true;
+    for (int r = 1; r < s; r++) {
+      x = MultModulo(x, x, n);
+      if (x == n - 1) {
+        composite = false;
+        break;
+      }
+    }
+    if (composite)
+      return false;
+  }
+  return true;
+}
+
+// In-place NTT over the prime in mont; values are in Montgomery form.
+static void Ntt(uint64_t *a, size_t n, const struct Montgomery *mont,
+                uint64_t root, bool invert) {
+  const uint64_t mod = mont->mod;
+
+  for (size_t i = 1, j = 0; i < n; i++) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      uint64_t tmp = a[i];
+      a[i] = a[j];
+      a[j] = tmp;
+    }
+  }
+
+  // Powers of a primitive n-th root; level len uses every (n / len)-th one.
+  uint64_t w_n = PowModulo(root, (mod - 1) / n, mod);
+  if (invert)
+    w_n = InvModulo(w_n, mod);
+  uint64_t *roots = malloc(sizeof(uint64_t) * (n / 2 + 1));
+  roots[0] = mont->one;
+  uint64_t w_n_form = MontgomeryToForm(mont, w_n);
+  for (size_t i = 1; i <= n / 2; i++)
+    roots[i] = MontgomeryMul(mont, roots[i - 1], w_n_form);
+
+  for (size_t len = 2; len <= n; len <<= 1) {
+    size_t half = len / 2;
+    size_t stride = n / len;
+    for (size_t i = 0; i < n; i += len) {
+      for (size_t j = 0; j < half; j++) {
+        uint64_t u = a[i + j];
+        uint64_t v = MontgomeryMul(mont, a[i + j + half], roots[j * stride]);
+        uint64_t sum = u + v;
+        a[i + j] = sum >= mod ? sum - mod : sum;
+        a[i + j + half] = u >= v ? u - v : u + mod - v;
+      }
+    }
+  }
+  free(roots);
+
+  if (invert) {
+    uint64_t n_inv = MontgomeryToForm(mont, InvModulo(n % mod, mod));
+    for (size_t i = 0; i < n; i++)
+      a[i] = MontgomeryMul(mont, a[i], n_inv);
+  }
+}
+
+// Computes out[k] = sum_i a[i] * b[na - 1 + k - i] mod p for k in
+// [0, nb - na], i.e. the middle part of the product that only sees full
+// overlaps of a and b.
+static void MiddleProduct(const uint64_t *a, size_t na, const uint64_t *b,
+                          size_t nb, uint64_t *out, uint64_t p) {
+  static const uint64_t primes[2] = {NTT_PRIME_1, NTT_PRIME_2};
+  static const uint64_t roots[2] = {NTT_ROOT_1, NTT_ROOT_2};
+  const size_t out_num = nb - na + 1;
+
+  // A cyclic product longer than nb only wraps indices below na - 1.
+  size_t n = 1;
+  while (n < nb)
+    n <<= 1;
+
+  uint64_t *fa = malloc(sizeof(uint64_t) * n);
+  uint64_t *fb = malloc(sizeof(uint64_t) * n);
+  uint64_t *residues = malloc(sizeof(uint64_t) * out_num);
+
+  for (int q = 0; q < 2; q++) {
+    struct Montgomery mont;
+    MontgomeryInit(&mont, primes[q]);
+
+    for (size_t i = 0; i < n; i++) {
+      fa[i] = i < na ? MontgomeryToForm(&mont, a[i]) : 0;
+      fb[i] = i < nb ? MontgomeryToForm(&mont, b[i]) : 0;
+    }
+    Ntt(fa, n, &mont, roots[q], false);
+    Ntt(fb, n, &mont, roots[q], false);
+    for (size_t i = 0; i < n; i++)
+      fa[i] = MontgomeryMul(&mont, fa[i], fb[i]);
+    Ntt(fa, n, &mont, roots[q], true);
+
+    if (q == 0) {
+      for (size_t k = 0; k < out_num; k++)
+        residues[k] = MontgomeryFromForm(&mont, fa[na - 1 + k]);
+      continue;
+    }
+
+    // Garner: x = r1 + p1 * ((r2 - r1) / p1 mod p2), exact below p1 * p2.
+    uint64_t p1_inv = InvModulo(NTT_PRIME_1 % NTT_PRIME_2, NTT_PRIME_2);
+    for (size_t k = 0; k < out_num; k++) {
+      uint64_t r1 = residues[k];
+      uint64_t r2 = MontgomeryFromForm(&mont, fa[na - 1 + k]);
+      uint64_t r1_mod = r1 % NTT_PRIME_2;
+      uint64_t diff = r2 >= r1_mod ? r2 - r1_mod : r2 + NTT_PRIME_2 - r1_mod;
+      uint64_t t = MultModulo(diff, p1_inv, NTT_PRIME_2);
+      unsigned __int128 x = (unsigned __int128)t * NTT_PRIME_1 + r1;
+      out[k] = (uint64_t)(x % p);
+    }
+  }
+
+  free(fa);
+  free(fb);
+  free(residues);
+}
+
+// Given h(0), ..., h(d) of a polynomial of degree <= d, writes
+// h(m), ..., h(m + d) by Lagrange interpolation. inv_fact must hold 1/i!
+// for i <= d. Fails if m - d .. m + d hits a multiple of p.
+static bool ShiftSamples(const uint64_t *h, size_t d, uint64_t m,
+                         const uint64_t *inv_fact, uint64_t p,
+                         uint64_t *out) {
+  const size_t nb = 2 * d + 1;
+  uint64_t *a = malloc(sizeof(uint64_t) * (d + 1));
+  uint64_t *t = malloc(sizeof(uint64_t) * nb);
+  uint64_t *b = malloc(sizeof(uint64_t) * nb);
+  bool ok = true;
+
+  // t[j] = m - d + j, b[j] = 1 / t[j] through one batched inversion.
+  uint64_t base = (m % p + p - d % p) % p;
+  uint64_t prefix = 1;
+  for (size_t j = 0; j < nb; j++) {
+    t[j] = (base + j) % p;
+    if (t[j] == 0) {
+      ok = false;
+      break;
+    }
+    b[j] = prefix;
+    prefix = MultModulo(prefix, t[j], p);
+  }
+
+  if (ok) {
+    uint64_t inv = InvModulo(prefix, p);
+    for (size_t j = nb; j-- > 0;) {
+      uint64_t before = b[j];
+      b[j] = MultModulo(inv, before, p);
+      inv = MultModulo(inv, t[j], p);
+    }
+
+    for (size_t i = 0; i <= d; i++) {
+      uint64_t coef = MultModulo(h[i], MultModulo(inv_fact[i], inv_fact[d - i], p), p);
+      a[i] = ((d - i) % 2 == 1 && coef != 0) ? p - coef : coef;
+    }
+
+    MiddleProduct(a, d + 1, b, nb, out, p);
+
+    // out[k] *= (m + k - d) * ... * (m + k), slid along t.
+    uint64_t window = 1;
+    for (size_t j = 0; j <= d; j++)
+      window = MultModulo(window, t[j], p);
+    for (size_t k = 0; k <= d; k++) {
+      if (k > 0)
+        window = MultModulo(MultModulo(window, t[k + d], p), b[k - 1], p);
+      out[k] = MultModulo(out[k], window, p);
+    }
+  }
+
+  free(a);
+  free(t);
+  free(b);
+  return ok;
+}
+
+// Computes (v * v)! mod p as prod_{x < v} g_v(x), where
+// g_d(x) = (v x + 1)(v x + 2)...(v x + d), by doubling d while keeping the
+// samples g_d(0), ..., g_d(d). Returns false if a shift hits a zero.
+static bool BlockFactorial(uint64_t v, uint64_t p, uint64_t *result) {
+  uint64_t *inv_fact = malloc(sizeof(uint64_t) * (v + 1));
+  uint64_t *g = malloc(sizeof(uint64_t) * (2 * v + 2));
+  uint64_t *shifted = malloc(sizeof(uint64_t) * (2 * v + 2));
+  uint64_t *tmp = malloc(sizeof(uint64_t) * (v + 1));
+  bool ok = true;
+
+  uint64_t fact = 1;
+  for (uint64_t i = 1; i <= v; i++)
+    fact = MultModulo(fact, i, p);
+  inv_fact[v] = InvModulo(fact, p);
+  for (uint64_t i = v; i > 0; i--)
+    inv_fact[i - 1] = MultModulo(inv_fact[i], i, p);
+
+  uint64_t v_inv = InvModulo(v, p);
+
+  size_t d = 1;
+  g[0] = 1;
+  g[1] = (v + 1) % p;
+
+  int top = 63 - __builtin_clzll(v);
+  for (int bit = top - 1; bit >= 0 && ok; bit--) {
+    // g_2d(x) = g_d(x) * g_d(x + d / v).
+    uint64_t dv = MultModulo(d, v_inv, p);
+    ok = ShiftSamples(g, d, d + 1, inv_fact, p, g + d + 1) &&
+         ShiftSamples(g, d, dv, inv_fact, p, shifted) &&
+         ShiftSamples(g, d, (dv + d + 1) % p, inv_fact, p, tmp);
+    if (!ok)
+      break;
+    memcpy(shifted + d + 1, tmp, sizeof(uint64_t) * (d + 1));
+    for (size_t x = 0; x <= 2 * d; x++)
+      g[x] = MultModulo(g[x], shifted[x], p);
+    d *= 2;
+
+    if ((v >> bit) & 1) {
+      // g_{d+1}(x) = g_d(x) * (v x + d + 1), plus the new sample at d + 1.
+      for (size_t x = 0; x <= d; x++)
+        g[x] = MultModulo(g[x], (MultModulo(v, x, p) + d + 1) % p, p);
+      uint64_t last = 1;
+      uint64_t start = MultModulo(v, d + 1, p);
+      for (size_t i = 1; i <= d + 1; i++)
+        last = MultModulo(last, (start + i) % p, p);
+      g[d + 1] = last;
+      d++;
+    }
+  }
+
+  if (ok) {
+    uint64_t ans = 1;
+    for (uint64_t x = 0; x < v; x++)
+      ans = MultModulo(ans, g[x], p);
+    *result = ans;
+  }
+
+  free(inv_fact);
+  free(g);
+  free(shifted);
+  free(tmp);
+  return ok;
+}
+
+uint64_t FactorialModPrime(uint64_t n, uint64_t p) {
+  if (n >= p)
+    return 0;
+
+  // Wilson: (p - 1)! = -1, so n! = (-1)^(m + 1) / m! with m = p - 1 - n.
+  uint64_t m = p - 1 - n;
+  if (m < n) {
+    uint64_t inv = InvModulo(FactorialModPrime(m, p), p);
+    return (m % 2 == 1 || inv == 0) ? inv : p - inv;
+  }
+
+  if (n < SUBLINEAR_MIN_RANGE || p > SUBLINEAR_MAX_MOD)
+    return MultRangeModulo(1, n, p);
+
+  uint64_t v = 1;
+  while ((v + 1) * (v + 1) <= n)
+    v++;
+
+  uint64_t block = 0;
+  if (!BlockFactorial(v, p, &block))
+    return MultRangeModulo(1, n, p);
+
+  return MultModulo(block, MultRangeModulo(v * v + 1, n, p), p);
+}
+
+bool FactorialFastPath(uint64_t begin, uint64_t end, uint64_t mod,
+                       uint64_t *result) {
+  if (mod == 0 || begin > end)
+    return false;
+
+  // Any multiple of mod in the range (including 0) zeroes the product.
+  if (begin == 0 || end / mod != (begin - 1) / mod) {
+    *result = 0;
+    return true;
+  }
+
+  if (end - begin + 1 < SUBLINEAR_MIN_RANGE || mod > SUBLINEAR_MAX_MOD ||
+      !IsPrime64(mod))
+    return false;
+
+  // The range sits inside one period (q * mod, (q + 1) * mod), so it
+  // reduces to a ratio of two factorials below mod.
+  uint64_t high = FactorialModPrime(end % mod, mod);
+  uint64_t low = FactorialModPrime((begin - 1) % mod, mod);
+  *result = MultModulo(high, InvModulo(low, mod), mod);
+  return true;
+}
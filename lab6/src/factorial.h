@@ -0,0 +1,27 @@
+#ifndef FACTORIAL_H
+#define FACTORIAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ranges shorter than this are cheaper to multiply out directly.
+#define SUBLINEAR_MIN_RANGE (1ULL << 20)
+// Largest prime the sublinear engine accepts. Its buffers grow with
+// sqrt(mod), so this keeps a single request within a few tens of MiB.
+#define SUBLINEAR_MAX_MOD (1ULL << 42)
+
+// Deterministic Miller-Rabin for the whole uint64_t range.
+bool IsPrime64(uint64_t n);
+
+// n! mod p for a prime p and n < p, in O(sqrt(n) log n) for
+// p <= SUBLINEAR_MAX_MOD (falls back to the linear product otherwise).
+uint64_t FactorialModPrime(uint64_t n, uint64_t p);
+
+// Answers prod[begin, end] mod mod without the linear loop when the math
+// allows it: the range contains a multiple of mod (the answer is 0), or mod
+// is prime and the range is long enough for the sublinear engine to win.
+// Returns false when only the linear loop applies.
+bool FactorialFastPath(uint64_t begin, uint64_t end, uint64_t mod,
+                       uint64_t *result);
+
+#endif
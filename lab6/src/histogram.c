@@ -0,0 +1,79 @@
+#include "histogram.h"
+
+static int BucketOf(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS)
+    return (int)value;
+  int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  return ((shift + 1) << HISTOGRAM_SUB_BITS) +
+         (int)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// Smallest value and width of bucket.
+static uint64_t BucketLow(int bucket, uint64_t *width) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    *width = 1;
+    return (uint64_t)bucket;
+  }
+  int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+  uint64_t sub = bucket & (HISTOGRAM_SUB_BUCKETS - 1);
+  *width = 1ULL << shift;
+  return (HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+static void Add(uint64_t *counter, uint64_t delta) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + delta,
+                   __ATOMIC_RELAXED);
+}
+
+static uint64_t Load(const uint64_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+void HistogramRecord(struct Histogram *histogram, uint64_t value) {
+  Add(&histogram->buckets[BucketOf(value)], 1);
+  Add(&histogram->count, 1);
+  Add(&histogram->sum, value);
+  if (value > Load(&histogram->max))
+    __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+}
+
+void HistogramMerge(struct Histogram *into, const struct Histogram *from) {
+  // Bucket counts are summed for the total rather than trusting from's
+  // count, so percentiles stay consistent with the buckets actually read.
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    uint64_t count = Load(&from->buckets[i]);
+    into->buckets[i] += count;
+    into->count += count;
+  }
+  into->sum += Load(&from->sum);
+  uint64_t max = Load(&from->max);
+  if (max > into->max)
+    into->max = max;
+}
+
+uint64_t HistogramPercentile(const struct Histogram *histogram, double pct) {
+  if (histogram->count == 0)
+    return 0;
+  if (pct >= 100)
+    return histogram->max;
+  uint64_t rank = (uint64_t)(pct / 100.0 * histogram->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  if (rank > histogram->count)
+    rank = histogram->count;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t width;
+      uint64_t value = BucketLow(i, &width) + width / 2;
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+double HistogramMean(const struct Histogram *histogram) {
+  return histogram->count ? (double)histogram->sum / histogram->count : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Values are grouped by power of two, and every power of two is split into
+// HISTOGRAM_SUB_BUCKETS equal buckets, so a recorded value is off by less
+// than 1/32 of itself (the HdrHistogram layout with a fixed precision).
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((65 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS)
+
+// Written by a single thread with relaxed atomic stores and no locked
+// instructions; other threads may read it at any time and see a slightly
+// stale but never torn state.
+struct Histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void HistogramRecord(struct Histogram *histogram, uint64_t value);
+// Adds a snapshot of from, which may still be written to, into into.
+void HistogramMerge(struct Histogram *into, const struct Histogram *from);
+
+// Value at percentile pct (0..100), reported as the middle of its bucket
+// and never above the largest recorded value. 0 for an empty histogram.
+uint64_t HistogramPercentile(const struct Histogram *histogram, double pct);
+double HistogramMean(const struct Histogram *histogram);
+
+#endif
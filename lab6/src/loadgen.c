@@ -0,0 +1,618 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include "pthread.h"
+#include "common.h"
+#include "histogram.h"
+#include "protocol.h"
+
+#define DEFAULT_CONNECTIONS 16
+#define DEFAULT_THREADS 1
+#define DEFAULT_DEPTH 1
+#define DEFAULT_BATCH 1
+#define DEFAULT_DURATION 10
+// Odd and composite, so neither the Montgomery loop nor the prime-only
+// sublinear engine is skipped or favoured by accident.
+#define DEFAULT_MOD 999999999ULL
+#define DRAIN_SECONDS 5
+#define MAX_EVENTS 64
+#define MAX_DEPTH 1024
+
+enum SizeKind { SIZE_FIXED, SIZE_UNIFORM, SIZE_EXP, SIZE_BIMODAL };
+
+// Numbers per tuple. fixed:N, uniform:A:B, exp:MEAN, or bimodal:A:B:P
+// (B with probability P percent, A otherwise).
+struct SizeDist {
+  enum SizeKind kind;
+  uint64_t a;
+  uint64_t b;
+  double pct;
+};
+
+struct Outstanding {
+  uint64_t id;
+  uint64_t intended_ns;
+  uint64_t numbers;
+  bool used;
+};
+
+// Requests are written into out and sent as the socket allows. In
+// fixed-rate mode next_ns is when the next request is due; requests that
+// are due while depth of them are still outstanding wait, and their
+// latency is still counted from when they were due.
+struct Connection {
+  int fd;
+  char out[MAX_DEPTH * 64];
+  size_t out_len;
+  char in[PROTOCOL_MAX_RESPONSE * 2];
+  size_t in_len;
+  struct Outstanding *outstanding;
+  int outstanding_num;
+  uint64_t next_id;
+  uint64_t next_ns;
+  bool want_out;
+  bool failed;
+};
+
+struct Settings {
+  struct Server server;
+  int connections;
+  int threads;
+  int depth;
+  int batch;
+  double rate;
+  double duration;
+  uint64_t mod;
+  uint64_t seed;
+  struct SizeDist size;
+};
+
+struct ThreadArgs {
+  const struct Settings *settings;
+  int connections_num;
+  uint64_t seed;
+  uint64_t start_ns;
+
+  struct Histogram latency_ns;
+  uint64_t requests;
+  uint64_t tuples;
+  uint64_t numbers;
+  uint64_t errors;
+  // Requests that fell due in fixed-rate mode but were never sent before
+  // the run ended.
+  uint64_t unsent;
+};
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t NextRandom(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static double NextUniform(uint64_t *state) {
+  return (NextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t SampleSize(const struct SizeDist *dist, uint64_t *state) {
+  uint64_t size = dist->a;
+  switch (dist->kind) {
+    case SIZE_FIXED:
+      break;
+    case SIZE_UNIFORM:
+      size = dist->a + NextRandom(state) % (dist->b - dist->a + 1);
+      break;
+    case SIZE_EXP:
+      size = (uint64_t)(-log(1.0 - NextUniform(state)) * dist->a);
+      break;
+    case SIZE_BIMODAL:
+      size = NextUniform(state) * 100 < dist->pct ? dist->b : dist->a;
+      break;
+  }
+  return size ? size : 1;
+}
+
+static bool ParseSizeDist(const char *text, struct SizeDist *dist) {
+  unsigned long long a = 0, b = 0;
+  double pct = 0;
+  char extra;
+  memset(dist, 0, sizeof(*dist));
+  if (sscanf(text, "fixed:%llu%c", &a, &extra) == 1) {
+    dist->kind = SIZE_FIXED;
+  } else if (sscanf(text, "uniform:%llu:%llu%c", &a, &b, &extra) == 2) {
+    dist->kind = SIZE_UNIFORM;
+    if (b < a)
+      return false;
+  } else if (sscanf(text, "exp:%llu%c", &a, &extra) == 1) {
+    dist->kind = SIZE_EXP;
+  } else if (sscanf(text, "bimodal:%llu:%llu:%lf%c", &a, &b, &pct, &extra) ==
+             3) {
+    dist->kind = SIZE_BIMODAL;
+    if (pct < 0 || pct > 100)
+      return false;
+  } else {
+    return false;
+  }
+  dist->a = a;
+  dist->b = b;
+  dist->pct = pct;
+  return a > 0;
+}
+
+static int ConnectToServer(const struct Server *server) {
+  struct hostent *hostname = gethostbyname(server->ip);
+  if (hostname == NULL) {
+    fprintf(stderr, "gethostbyname failed with %s\n", server->ip);
+    return -1;
+  }
+
+  struct sockaddr_in server_addr;
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(server->port);
+  server_addr.sin_addr.s_addr = *((unsigned long *)hostname->h_addr);
+
+  int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (sockfd < 0) {
+    fprintf(stderr, "Socket creation failed!\n");
+    return -1;
+  }
+
+  // Connected non-blocking; EPOLLOUT reports when the handshake is done.
+  if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) <
+          0 &&
+      errno != EINPROGRESS) {
+    fprintf(stderr, "Connection to %s:%d failed\n", server->ip, server->port);
+    close(sockfd);
+    return -1;
+  }
+
+  int opt_val = 1;
+  setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &opt_val, sizeof(opt_val));
+  return sockfd;
+}
+
+// Appends one request frame whose latency counts from intended_ns.
+static void QueueRequest(struct ThreadArgs *args, struct Connection *conn,
+                         uint64_t intended_ns, uint64_t *rng) {
+  const struct Settings *settings = args->settings;
+  struct FactorialArgs items[PROTOCOL_MAX_BATCH];
+  uint64_t numbers = 0;
+  for (int i = 0; i < settings->batch; i++) {
+    uint64_t size = SampleSize(&settings->size, rng);
+    uint64_t span = settings->mod > size ? settings->mod - size : 1;
+    items[i].begin = 1 + NextRandom(rng) % span;
+    items[i].end = items[i].begin + size - 1;
+    items[i].mod = settings->mod;
+    numbers += size;
+  }
+
+  struct Outstanding *slot = NULL;
+  for (int i = 0; i < settings->depth; i++) {
+    if (!conn->outstanding[i].used) {
+      slot = &conn->outstanding[i];
+      break;
+    }
+  }
+  slot->used = true;
+  slot->id = conn->next_id++;
+  slot->intended_ns = intended_ns;
+  slot->numbers = numbers;
+  conn->outstanding_num++;
+
+  conn->out_len += EncodeRequest(conn->out + conn->out_len, slot->id, items,
+                                 (uint16_t)settings->batch);
+}
+
+static bool FlushConnection(struct Connection *conn) {
+  size_t sent = 0;
+  while (sent < conn->out_len) {
+    ssize_t n = send(conn->fd, conn->out + sent, conn->out_len - sent,
+                     MSG_NOSIGNAL);
+    if (n > 0)
+      sent += n;
+    else if (n < 0 && errno == EINTR)
+      continue;
+    else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    else
+      return false;
+  }
+  memmove(conn->out, conn->out + sent, conn->out_len - sent);
+  conn->out_len -= sent;
+  return true;
+}
+
+static bool ReadReplies(struct ThreadArgs *args, struct Connection *conn) {
+  while (true) {
+    ssize_t n = recv(conn->fd, conn->in + conn->in_len,
+                     sizeof(conn->in) - conn->in_len, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return true;
+    if (n <= 0)
+      return false;
+    conn->in_len += n;
+    uint64_t now = NowNs();
+
+    size_t consumed = 0;
+    while (conn->in_len - consumed >= FRAME_HEADER_SIZE) {
+      struct FrameHeader header;
+      if (DecodeFrameHeader(conn->in + consumed, &header) != PROTOCOL_OK)
+        return false;
+      size_t frame_size = FRAME_HEADER_SIZE + header.length;
+      if (conn->in_len - consumed < frame_size)
+        break;
+      consumed += frame_size;
+
+      struct Outstanding *slot = NULL;
+      for (int i = 0; i < args->settings->depth; i++) {
+        if (conn->outstanding[i].used && conn->outstanding[i].id == header.id) {
+          slot = &conn->outstanding[i];
+          break;
+        }
+      }
+      if (!slot || header.type != FRAME_RESPONSE) {
+        args->errors++;
+        return false;
+      }
+
+      HistogramRecord(&args->latency_ns, now - slot->intended_ns);
+      args->requests++;
+      args->tuples += header.count;
+      args->numbers += slot->numbers;
+      slot->used = false;
+      conn->outstanding_num--;
+    }
+    memmove(conn->in, conn->in + consumed, conn->in_len - consumed);
+    conn->in_len -= consumed;
+  }
+}
+
+static void WatchOutput(int epoll_fd, struct Connection *conn, bool want_out) {
+  if (conn->want_out == want_out)
+    return;
+  struct epoll_event event;
+  event.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+  event.data.ptr = conn;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+  conn->want_out = want_out;
+}
+
+// Issues whatever the mode allows: in closed-loop mode, top the
+// connection up to depth outstanding requests; in fixed-rate mode, send
+// every request that has fallen due, up to depth outstanding.
+static void IssueRequests(struct ThreadArgs *args, struct Connection *conn,
+                          uint64_t now, uint64_t interval_ns, uint64_t *rng) {
+  const struct Settings *settings = args->settings;
+  while (conn->outstanding_num < settings->depth) {
+    uint64_t intended = now;
+    if (interval_ns) {
+      if (conn->next_ns > now)
+        break;
+      intended = conn->next_ns;
+      conn->next_ns += interval_ns;
+    }
+    QueueRequest(args, conn, intended, rng);
+  }
+}
+
+void *LoadThread(void *argument) {
+  struct ThreadArgs *args = (struct ThreadArgs *)argument;
+  const struct Settings *settings = args->settings;
+  uint64_t rng = args->seed;
+
+  // The total rate is split evenly; connections start staggered so their
+  // requests do not arrive in lockstep.
+  double per_connection = settings->rate / settings->connections;
+  uint64_t interval_ns = settings->rate > 0 ? (uint64_t)(1e9 / per_connection)
+                                            : 0;
+  uint64_t end_ns = args->start_ns + (uint64_t)(settings->duration * 1e9);
+
+  int epoll_fd = epoll_create1(0);
+  struct Connection *conns =
+      calloc(args->connections_num, sizeof(struct Connection));
+  int live = 0;
+  for (int i = 0; i < args->connections_num; i++) {
+    struct Connection *conn = &conns[i];
+    conn->outstanding = calloc(settings->depth, sizeof(struct Outstanding));
+    conn->next_id = 1;
+    conn->next_ns = args->start_ns + (interval_ns ? NextRandom(&rng) % interval_ns : 0);
+    conn->fd = ConnectToServer(&settings->server);
+    if (conn->fd < 0) {
+      conn->failed = true;
+      args->errors++;
+      continue;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+    conn->want_out = true;
+    live++;
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  bool draining = false;
+  while (live > 0) {
+    uint64_t now = NowNs();
+    if (!draining && now >= end_ns)
+      draining = true;
+    if (draining) {
+      bool idle = true;
+      for (int i = 0; i < args->connections_num; i++)
+        idle &= conns[i].failed || conns[i].outstanding_num == 0;
+      if (idle || now >= end_ns + DRAIN_SECONDS * 1000000000ULL)
+        break;
+    }
+
+    int wait_ms = draining ? 10 : (int)((end_ns - now) / 1000000) + 1;
+    for (int i = 0; i < args->connections_num && !draining; i++) {
+      struct Connection *conn = &conns[i];
+      if (conn->failed)
+        continue;
+      IssueRequests(args, conn, now, interval_ns, &rng);
+      if (conn->out_len > 0 && !FlushConnection(conn)) {
+        conn->failed = true;
+        args->errors++;
+        close(conn->fd);
+        live--;
+        continue;
+      }
+      WatchOutput(epoll_fd, conn, conn->out_len > 0);
+      if (interval_ns && conn->outstanding_num < settings->depth) {
+        uint64_t due = conn->next_ns > now ? conn->next_ns - now : 0;
+        if ((int)(due / 1000000) < wait_ms)
+          wait_ms = (int)(due / 1000000);
+      }
+    }
+
+    // Sub-millisecond intervals are served by spinning on a zero timeout.
+    int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, wait_ms);
+    for (int i = 0; i < ready; i++) {
+      struct Connection *conn = events[i].data.ptr;
+      if (conn->failed)
+        continue;
+      bool ok = true;
+      if (events[i].events & (EPOLLERR | EPOLLHUP))
+        ok = false;
+      if (ok && (events[i].events & EPOLLOUT))
+        ok = FlushConnection(conn);
+      if (ok && (events[i].events & EPOLLIN))
+        ok = ReadReplies(args, conn);
+      if (!ok) {
+        conn->failed = true;
+        args->errors++;
+        close(conn->fd);
+        live--;
+        continue;
+      }
+      WatchOutput(epoll_fd, conn, conn->out_len > 0);
+    }
+  }
+
+  for (int i = 0; i < args->connections_num; i++) {
+    struct Connection *conn = &conns[i];
+    if (interval_ns && conn->next_ns < end_ns)
+      args->unsent += (end_ns - conn->next_ns) / interval_ns + 1;
+    if (!conn->failed)
+      close(conn->fd);
+    free(conn->outstanding);
+  }
+  free(conns);
+  close(epoll_fd);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  struct Settings settings;
+  memset(&settings, 0, sizeof(settings));
+  settings.connections = DEFAULT_CONNECTIONS;
+  settings.threads = DEFAULT_THREADS;
+  settings.depth = DEFAULT_DEPTH;
+  settings.batch = DEFAULT_BATCH;
+  settings.duration = DEFAULT_DURATION;
+  settings.mod = DEFAULT_MOD;
+  settings.seed = 1;
+  settings.size.kind = SIZE_FIXED;
+  settings.size.a = 1000;
+  char server[255] = {'\0'};
+
+  while (true) {
+    static struct option options[] = {{"server", required_argument, 0, 0},
+                                      {"connections", required_argument, 0, 0},
+                                      {"threads", required_argument, 0, 0},
+                                      {"depth", required_argument, 0, 0},
+                                      {"rate", required_argument, 0, 0},
+                                      {"duration", required_argument, 0, 0},
+                                      {"size", required_argument, 0, 0},
+                                      {"batch", required_argument, 0, 0},
+                                      {"mod", required_argument, 0, 0},
+                                      {"seed", required_argument, 0, 0},
+                                      {0, 0, 0, 0}};
+
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "", options, &option_index);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+    case 0: {
+      switch (option_index) {
+      case 0:
+        strncpy(server, optarg, sizeof(server) - 1);
+        break;
+      case 1:
+        settings.connections = atoi(optarg);
+        if (settings.connections <= 0) {
+          fprintf(stderr, "connections must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 2:
+        settings.threads = atoi(optarg);
+        if (settings.threads <= 0) {
+          fprintf(stderr, "threads must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 3:
+        settings.depth = atoi(optarg);
+        if (settings.depth <= 0 || settings.depth > MAX_DEPTH) {
+          fprintf(stderr, "depth must be in [1, %d]\n", MAX_DEPTH);
+          return 1;
+        }
+        break;
+      case 4:
+        settings.rate = atof(optarg);
+        if (settings.rate < 0) {
+          fprintf(stderr, "rate must not be negative\n");
+          return 1;
+        }
+        break;
+      case 5:
+        settings.duration = atof(optarg);
+        if (settings.duration <= 0) {
+          fprintf(stderr, "duration must be positive\n");
+          return 1;
+        }
+        break;
+      case 6:
+        if (!ParseSizeDist(optarg, &settings.size)) {
+          fprintf(stderr, "size must be fixed:N, uniform:A:B, exp:MEAN or "
+                          "bimodal:A:B:PCT\n");
+          return 1;
+        }
+        break;
+      case 7:
+        settings.batch = atoi(optarg);
+        if (settings.batch <= 0 || settings.batch > PROTOCOL_MAX_BATCH) {
+          fprintf(stderr, "batch must be in [1, %d]\n", PROTOCOL_MAX_BATCH);
+          return 1;
+        }
+        break;
+      case 8:
+        if (!ConvertStringToUI64(optarg, &settings.mod) || settings.mod < 2) {
+          fprintf(stderr, "mod must be at least 2\n");
+          return 1;
+        }
+        break;
+      case 9:
+        ConvertStringToUI64(optarg, &settings.seed);
+        break;
+      default:
+        printf("Index %d is out of options\n", option_index);
+      }
+    } break;
+
+    case '?':
+      printf("Arguments error\n");
+      break;
+    default:
+      fprintf(stderr, "getopt returned character code 0%o?\n", c);
+    }
+  }
+
+  char *colon = strchr(server, ':');
+  if (!colon) {
+    fprintf(stderr,
+            "Using: %s --server 127.0.0.1:20001 [--connections 16] "
+            "[--threads 1] [--depth 1] [--rate 0] [--duration 10] "
+            "[--size fixed:1000] [--batch 1] [--mod 999999999] [--seed 1]\n"
+            "--rate 0 runs closed-loop, otherwise requests/s over all "
+            "connections\n",
+            argv[0]);
+    return 1;
+  }
+  *colon = '\0';
+  strncpy(settings.server.ip, server, sizeof(settings.server.ip) - 1);
+  settings.server.port = atoi(colon + 1);
+  if (settings.threads > settings.connections)
+    settings.threads = settings.connections;
+
+  // Frames for a full window of requests must fit a connection's buffer.
+  size_t window = settings.depth *
+                  (FRAME_HEADER_SIZE + settings.batch * FRAME_TUPLE_SIZE);
+  if (window > sizeof(((struct Connection *)0)->out)) {
+    fprintf(stderr, "depth * batch is too large\n");
+    return 1;
+  }
+
+  pthread_t threads[settings.threads];
+  struct ThreadArgs *thread_args =
+      calloc(settings.threads, sizeof(struct ThreadArgs));
+  uint64_t start_ns = NowNs();
+  for (int i = 0; i < settings.threads; i++) {
+    thread_args[i].settings = &settings;
+    thread_args[i].connections_num =
+        settings.connections * (i + 1) / settings.threads -
+        settings.connections * i / settings.threads;
+    thread_args[i].seed = settings.seed * 0x9E3779B97F4A7C15ULL + i;
+    thread_args[i].start_ns = start_ns;
+    if (pthread_create(&threads[i], NULL, LoadThread, &thread_args[i])) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+
+  static struct Histogram latency_ns;
+  uint64_t requests = 0, tuples = 0, numbers = 0, errors = 0, unsent = 0;
+  for (int i = 0; i < settings.threads; i++) {
+    pthread_join(threads[i], NULL);
+    HistogramMerge(&latency_ns, &thread_args[i].latency_ns);
+    requests += thread_args[i].requests;
+    tuples += thread_args[i].tuples;
+    numbers += thread_args[i].numbers;
+    errors += thread_args[i].errors;
+    unsent += thread_args[i].unsent;
+  }
+  double elapsed = (NowNs() - start_ns) / 1e9;
+
+  if (settings.rate > 0)
+    printf("Mode: fixed rate %.0f req/s, latency from intended send time\n",
+           settings.rate);
+  else
+    printf("Mode: closed loop, %d outstanding per connection\n",
+           settings.depth);
+  printf("Connections: %d on %d threads, batch %d\n", settings.connections,
+         settings.threads, settings.batch);
+  printf("Requests: %llu in %.2f s (%.1f req/s, %.1f tuples/s, %.3g "
+         "numbers/s)\n",
+         (unsigned long long)requests, elapsed, requests / elapsed,
+         tuples / elapsed, numbers / elapsed);
+  printf("Latency (us): mean %.1f p50 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+         HistogramMean(&latency_ns) / 1e3,
+         HistogramPercentile(&latency_ns, 50) / 1e3,
+         HistogramPercentile(&latency_ns, 99) / 1e3,
+         HistogramPercentile(&latency_ns, 99.9) / 1e3, latency_ns.max / 1e3);
+  if (unsent)
+    printf("Unsent: %llu requests fell due but were never sent; the rate "
+           "was not sustained\n",
+           (unsigned long long)unsent);
+  if (errors)
+    printf("Errors: %llu\n", (unsigned long long)errors);
+
+  free(thread_args);
+  return errors ? 1 : 0;
+}
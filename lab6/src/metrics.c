@@ -0,0 +1,143 @@
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *size_class_names[SIZE_CLASS_COUNT] = {
+    [SIZE_UP_TO_1K] = "<=1K",   [SIZE_UP_TO_64K] = "<=64K",
+    [SIZE_UP_TO_1M] = "<=1M",   [SIZE_UP_TO_16M] = "<=16M",
+    [SIZE_ABOVE_16M] = ">16M",
+};
+
+static __thread struct WorkerMetrics *current_worker = NULL;
+
+uint64_t MetricsNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum SizeClass SizeClassOf(uint64_t numbers) {
+  if (numbers <= (1ULL << 10))
+    return SIZE_UP_TO_1K;
+  if (numbers <= (1ULL << 16))
+    return SIZE_UP_TO_64K;
+  if (numbers <= (1ULL << 20))
+    return SIZE_UP_TO_1M;
+  if (numbers <= (1ULL << 24))
+    return SIZE_UP_TO_16M;
+  return SIZE_ABOVE_16M;
+}
+
+void MetricsInit(struct ServerMetrics *metrics, int workers_num) {
+  memset(metrics, 0, sizeof(*metrics));
+  metrics->start_ns = MetricsNow();
+  metrics->workers_num = workers_num;
+  metrics->workers =
+      aligned_alloc(64, sizeof(struct WorkerMetrics) * workers_num);
+  memset(metrics->workers, 0, sizeof(struct WorkerMetrics) * workers_num);
+}
+
+void MetricsAdd(uint64_t *counter, uint64_t delta) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + delta,
+                   __ATOMIC_RELAXED);
+}
+
+struct WorkerMetrics *MetricsWorker(struct ServerMetrics *metrics) {
+  if (!current_worker) {
+    int id = __atomic_fetch_add(&metrics->workers_registered, 1,
+                                __ATOMIC_RELAXED);
+    // Only pool workers call this, and there are workers_num of them.
+    if (id >= metrics->workers_num)
+      id = metrics->workers_num - 1;
+    current_worker = &metrics->workers[id];
+  }
+  return current_worker;
+}
+
+static uint64_t Load(const uint64_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+struct Output {
+  char *buf;
+  size_t size;
+  size_t len;
+};
+
+static void Append(struct Output *out, const char *format, ...) {
+  if (out->len + 1 >= out->size)
+    return;
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(out->buf + out->len, out->size - out->len, format, args);
+  va_end(args);
+  if (n > 0)
+    out->len += (size_t)n < out->size - out->len ? (size_t)n
+                                                 : out->size - out->len - 1;
+}
+
+// Snapshots are only formatted from the event loop, so one static buffer
+// keeps the 15 KiB histogram off the stack.
+static void AppendHistogram(struct Output *out, const struct Histogram *live) {
+  static struct Histogram snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  HistogramMerge(&snapshot, live);
+  Append(out,
+         " count=%llu mean=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f "
+         "max=%.1f\n",
+         (unsigned long long)snapshot.count, HistogramMean(&snapshot) / 1e3,
+         HistogramPercentile(&snapshot, 50) / 1e3,
+         HistogramPercentile(&snapshot, 90) / 1e3,
+         HistogramPercentile(&snapshot, 99) / 1e3,
+         HistogramPercentile(&snapshot, 99.9) / 1e3, snapshot.max / 1e3);
+}
+
+size_t MetricsFormat(const struct ServerMetrics *metrics, char *buf,
+                     size_t size) {
+  struct Output out = {buf, size, 0};
+  if (size > 0)
+    buf[0] = '\0';
+
+  Append(&out, "uptime_seconds %.3f\n",
+         (MetricsNow() - metrics->start_ns) / 1e9);
+  Append(&out, "connections_accepted %llu\n",
+         (unsigned long long)Load(&metrics->connections_accepted));
+  Append(&out, "connections_open %llu\n",
+         (unsigned long long)Load(&metrics->connections_open));
+  Append(&out, "frames %llu\n", (unsigned long long)Load(&metrics->frames));
+  Append(&out, "tuples %llu\n", (unsigned long long)Load(&metrics->tuples));
+  Append(&out, "replies %llu\n", (unsigned long long)Load(&metrics->replies));
+  Append(&out, "protocol_errors %llu\n",
+         (unsigned long long)Load(&metrics->protocol_errors));
+  Append(&out, "bytes_in %llu\n", (unsigned long long)Load(&metrics->bytes_in));
+  Append(&out, "bytes_out %llu\n",
+         (unsigned long long)Load(&metrics->bytes_out));
+
+  // Latencies are printed in microseconds.
+  for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+    Append(&out, "latency_us{size=\"%s\"}", size_class_names[i]);
+    AppendHistogram(&out, &metrics->latency_ns[i]);
+  }
+
+  int workers = __atomic_load_n(&metrics->workers_registered,
+                                __ATOMIC_RELAXED);
+  if (workers > metrics->workers_num)
+    workers = metrics->workers_num;
+  for (int i = 0; i < workers; i++) {
+    const struct WorkerMetrics *worker = &metrics->workers[i];
+    Append(&out,
+           "worker{id=%d} tasks=%llu numbers=%llu busy_seconds=%.3f "
+           "fast_path=%llu\n",
+           i, (unsigned long long)Load(&worker->tasks),
+           (unsigned long long)Load(&worker->numbers),
+           Load(&worker->busy_ns) / 1e9,
+           (unsigned long long)Load(&worker->fast_path));
+    Append(&out, "task_us{worker=%d}", i);
+    AppendHistogram(&out, &worker->task_ns);
+  }
+  return out.len;
+}
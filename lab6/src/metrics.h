@@ -0,0 +1,63 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+// Requests are classed by how many numbers they multiply in total.
+enum SizeClass {
+  SIZE_UP_TO_1K,
+  SIZE_UP_TO_64K,
+  SIZE_UP_TO_1M,
+  SIZE_UP_TO_16M,
+  SIZE_ABOVE_16M,
+  SIZE_CLASS_COUNT
+};
+
+// One pool worker's share, written only by that worker.
+struct WorkerMetrics {
+  uint64_t tasks;
+  uint64_t numbers;
+  uint64_t busy_ns;
+  // Tuples answered by FactorialFastPath instead of the pool.
+  uint64_t fast_path;
+  struct Histogram task_ns;
+} __attribute__((aligned(64)));
+
+// Everything except the worker shards is written by the event loop only,
+// so no counter is shared between writers and nothing takes a lock.
+struct ServerMetrics {
+  uint64_t start_ns;
+  uint64_t connections_accepted;
+  uint64_t connections_open;
+  uint64_t frames;
+  uint64_t tuples;
+  uint64_t replies;
+  uint64_t protocol_errors;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  // From a frame being decoded to its reply being queued.
+  struct Histogram latency_ns[SIZE_CLASS_COUNT];
+
+  struct WorkerMetrics *workers;
+  int workers_num;
+  int workers_registered;
+};
+
+uint64_t MetricsNow(void);
+enum SizeClass SizeClassOf(uint64_t numbers);
+
+void MetricsInit(struct ServerMetrics *metrics, int workers_num);
+// Increments a counter that only the calling thread writes.
+void MetricsAdd(uint64_t *counter, uint64_t delta);
+// The calling thread's shard; a thread claims one on its first call.
+struct WorkerMetrics *MetricsWorker(struct ServerMetrics *metrics);
+
+// Writes a plain-text snapshot, one metric per line, and returns its
+// length (truncated to size - 1 bytes).
+size_t MetricsFormat(const struct ServerMetrics *metrics, char *buf,
+                     size_t size);
+
+#endif
@@ -0,0 +1,68 @@
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void *PoolWorker(void *args) {
+  struct ThreadPool *pool = (struct ThreadPool *)args;
+
+  while (true) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->head && !pool->stopping)
+      pthread_cond_wait(&pool->not_empty, &pool->lock);
+    struct PoolTask *task = pool->head;
+    if (!task) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    pool->head = task->next;
+    if (!pool->head)
+      pool->tail = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    task->run(task);
+  }
+}
+
+bool ThreadPoolInit(struct ThreadPool *pool, int threads_num) {
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->not_empty, NULL);
+  pool->head = pool->tail = NULL;
+  pool->stopping = false;
+  pool->threads = malloc(sizeof(pthread_t) * threads_num);
+  pool->threads_num = 0;
+
+  for (int i = 0; i < threads_num; i++) {
+    if (pthread_create(&pool->threads[i], NULL, PoolWorker, pool)) {
+      fprintf(stderr, "Error: pthread_create failed!\n");
+      break;
+    }
+    pool->threads_num++;
+  }
+  return pool->threads_num > 0;
+}
+
+void ThreadPoolSubmit(struct ThreadPool *pool, struct PoolTask *task) {
+  task->next = NULL;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->tail)
+    pool->tail->next = task;
+  else
+    pool->head = task;
+  pool->tail = task;
+  pthread_cond_signal(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void ThreadPoolDestroy(struct ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->threads_num; i++)
+    pthread_join(pool->threads[i], NULL);
+  free(pool->threads);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->not_empty);
+}
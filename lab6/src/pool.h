@@ -0,0 +1,30 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// Intrusive task: embed it in a larger struct and recover the outer
+// object in run(). The pool never allocates or frees tasks.
+struct PoolTask {
+  void (*run)(struct PoolTask *task);
+  struct PoolTask *next;
+};
+
+struct ThreadPool {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  struct PoolTask *head;
+  struct PoolTask *tail;
+  pthread_t *threads;
+  int threads_num;
+  bool stopping;
+};
+
+// Starts threads_num workers. Returns false if none could be started.
+bool ThreadPoolInit(struct ThreadPool *pool, int threads_num);
+void ThreadPoolSubmit(struct ThreadPool *pool, struct PoolTask *task);
+// Lets the workers finish queued tasks, then joins them.
+void ThreadPoolDestroy(struct ThreadPool *pool);
+
+#endif
@@ -0,0 +1,144 @@
+#include "protocol.h"
+
+#include <endian.h>
+#include <string.h>
+
+static void PutU16(char *buf, uint16_t value) {
+  value = htobe16(value);
+  memcpy(buf, &value, sizeof(value));
+}
+
+static void PutU32(char *buf, uint32_t value) {
+  value = htobe32(value);
+  memcpy(buf, &value, sizeof(value));
+}
+
+static void PutU64(char *buf, uint64_t value) {
+  value = htobe64(value);
+  memcpy(buf, &value, sizeof(value));
+}
+
+static uint16_t GetU16(const char *buf) {
+  uint16_t value;
+  memcpy(&value, buf, sizeof(value));
+  return be16toh(value);
+}
+
+static uint32_t GetU32(const char *buf) {
+  uint32_t value;
+  memcpy(&value, buf, sizeof(value));
+  return be32toh(value);
+}
+
+static uint64_t GetU64(const char *buf) {
+  uint64_t value;
+  memcpy(&value, buf, sizeof(value));
+  return be64toh(value);
+}
+
+static void EncodeHeader(char *buf, const struct FrameHeader *header) {
+  PutU32(buf, header->length);
+  buf[4] = (char)header->version;
+  buf[5] = (char)header->type;
+  PutU16(buf + 6, header->count);
+  PutU64(buf + 8, header->id);
+}
+
+enum ProtocolError DecodeFrameHeader(const char *buf,
+                                     struct FrameHeader *header) {
+  header->length = GetU32(buf);
+  header->version = (uint8_t)buf[4];
+  header->type = (uint8_t)buf[5];
+  header->count = GetU16(buf + 6);
+  header->id = GetU64(buf + 8);
+
+  if (header->version != PROTOCOL_VERSION)
+    return PROTOCOL_BAD_VERSION;
+
+  switch (header->type) {
+    case FRAME_REQUEST:
+      if (header->count == 0 || header->count > PROTOCOL_MAX_BATCH ||
+          header->length != header->count * FRAME_TUPLE_SIZE)
+        return PROTOCOL_BAD_LENGTH;
+      return PROTOCOL_OK;
+    case FRAME_RESPONSE:
+      if (header->count == 0 || header->count > PROTOCOL_MAX_BATCH ||
+          header->length != header->count * FRAME_RESULT_SIZE)
+        return PROTOCOL_BAD_LENGTH;
+      return PROTOCOL_OK;
+    case FRAME_ERROR:
+      if (header->count != 0 || header->length != sizeof(uint32_t))
+        return PROTOCOL_BAD_LENGTH;
+      return PROTOCOL_OK;
+    default:
+      return PROTOCOL_BAD_TYPE;
+  }
+}
+
+const char *ProtocolErrorName(enum ProtocolError error) {
+  switch (error) {
+    case PROTOCOL_OK:
+      return "ok";
+    case PROTOCOL_BAD_VERSION:
+      return "unsupported protocol version";
+    case PROTOCOL_BAD_TYPE:
+      return "unknown frame type";
+    case PROTOCOL_BAD_LENGTH:
+      return "frame length does not match its contents";
+    default:
+      return "unknown error";
+  }
+}
+
+size_t EncodeRequest(char *buf, uint64_t id, const struct FactorialArgs *items,
+                     uint16_t count) {
+  struct FrameHeader header = {count * FRAME_TUPLE_SIZE, PROTOCOL_VERSION,
+                               FRAME_REQUEST, count, id};
+  EncodeHeader(buf, &header);
+  char *payload = buf + FRAME_HEADER_SIZE;
+  for (uint16_t i = 0; i < count; i++) {
+    PutU64(payload, items[i].begin);
+    PutU64(payload + 8, items[i].end);
+    PutU64(payload + 16, items[i].mod);
+    payload += FRAME_TUPLE_SIZE;
+  }
+  return FRAME_HEADER_SIZE + header.length;
+}
+
+size_t EncodeResponse(char *buf, uint64_t id, const uint64_t *results,
+                      uint16_t count) {
+  struct FrameHeader header = {count * FRAME_RESULT_SIZE, PROTOCOL_VERSION,
+                               FRAME_RESPONSE, count, id};
+  EncodeHeader(buf, &header);
+  for (uint16_t i = 0; i < count; i++)
+    PutU64(buf + FRAME_HEADER_SIZE + i * FRAME_RESULT_SIZE, results[i]);
+  return FRAME_HEADER_SIZE + header.length;
+}
+
+size_t EncodeError(char *buf, uint64_t id, enum ProtocolError error) {
+  struct FrameHeader header = {sizeof(uint32_t), PROTOCOL_VERSION, FRAME_ERROR,
+                               0, id};
+  EncodeHeader(buf, &header);
+  PutU32(buf + FRAME_HEADER_SIZE, (uint32_t)error);
+  return FRAME_HEADER_SIZE + header.length;
+}
+
+void DecodeRequestItems(const char *payload, uint16_t count,
+                        struct FactorialArgs *items) {
+  for (uint16_t i = 0; i < count; i++) {
+    items[i].begin = GetU64(payload);
+    items[i].end = GetU64(payload + 8);
+    items[i].mod = GetU64(payload + 16);
+    payload += FRAME_TUPLE_SIZE;
+  }
+}
+
+void DecodeResponseResults(const char *payload, uint16_t count,
+                           uint64_t *results) {
+  for (uint16_t i = 0; i < count; i++)
+    results[i] = GetU64(payload + i * FRAME_RESULT_SIZE);
+}
+
+enum ProtocolError DecodeErrorCode(const char *payload) {
+  return (enum ProtocolError)GetU32(payload);
+}
@@ -0,0 +1,76 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+// Every frame starts with a fixed header, all fields in network byte
+// order:
+//
+//   uint32 length   payload bytes following the header
+//   uint8  version  PROTOCOL_VERSION
+//   uint8  type     enum FrameType
+//   uint16 count    tuples in the payload
+//   uint64 id       chosen by the client, echoed in the reply
+//
+// A request carries count (begin, end, mod) tuples of three uint64 each,
+// a response carries count uint64 results in the same order. Replies to
+// different requests on one connection may arrive in any order.
+#define PROTOCOL_VERSION 1
+#define FRAME_HEADER_SIZE 16
+#define FRAME_TUPLE_SIZE (3 * sizeof(uint64_t))
+#define FRAME_RESULT_SIZE sizeof(uint64_t)
+#define PROTOCOL_MAX_BATCH 256
+#define PROTOCOL_MAX_REQUEST \
+  (FRAME_HEADER_SIZE + PROTOCOL_MAX_BATCH * FRAME_TUPLE_SIZE)
+#define PROTOCOL_MAX_RESPONSE \
+  (FRAME_HEADER_SIZE + PROTOCOL_MAX_BATCH * FRAME_RESULT_SIZE)
+
+enum FrameType {
+  FRAME_REQUEST = 1,
+  FRAME_RESPONSE = 2,
+  // Payload is one uint32 enum ProtocolError; the sender then closes
+  // the connection.
+  FRAME_ERROR = 3,
+};
+
+enum ProtocolError {
+  PROTOCOL_OK = 0,
+  PROTOCOL_BAD_VERSION,
+  PROTOCOL_BAD_TYPE,
+  PROTOCOL_BAD_LENGTH,
+};
+
+struct FrameHeader {
+  uint32_t length;
+  uint8_t version;
+  uint8_t type;
+  uint16_t count;
+  uint64_t id;
+};
+
+// Reads and validates a header from FRAME_HEADER_SIZE bytes. The length
+// is checked against the count for the frame type, so a frame that
+// passes never exceeds PROTOCOL_MAX_REQUEST bytes.
+enum ProtocolError DecodeFrameHeader(const char *buf,
+                                     struct FrameHeader *header);
+const char *ProtocolErrorName(enum ProtocolError error);
+
+// Encoders write a complete frame and return its size. buf must hold
+// FRAME_HEADER_SIZE plus the payload.
+size_t EncodeRequest(char *buf, uint64_t id, const struct FactorialArgs *items,
+                     uint16_t count);
+size_t EncodeResponse(char *buf, uint64_t id, const uint64_t *results,
+                      uint16_t count);
+size_t EncodeError(char *buf, uint64_t id, enum ProtocolError error);
+
+// Decode the payload of a frame whose header has been validated.
+void DecodeRequestItems(const char *payload, uint16_t count,
+                        struct FactorialArgs *items);
+void DecodeResponseResults(const char *payload, uint16_t count,
+                           uint64_t *results);
+enum ProtocolError DecodeErrorCode(const char *payload);
+
+#endif
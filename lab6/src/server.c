@@ -5,40 +5,572 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include "pthread.h"
 #include "common.h"
+#include "block_index.h"
+#include "factorial.h"
+#include "metrics.h"
+#include "pool.h"
+#include "protocol.h"
 
 uint64_t Factorial(const struct FactorialArgs *args) {
-  uint64_t ans = 1;
+  return MultRangeModulo(args->begin, args->end, args->mod);
+}
+
+#define INPUT_BUFFER_SIZE 8192
+#define OUTPUT_BUFFER_SIZE 32768
+#define MAX_EVENTS 256
+#define DEFAULT_INDEX_MB 64
+#define DEFAULT_INDEX_BLOCK 4096
+// Ranges are not split into slices shorter than this.
+#define MIN_SLICE_LENGTH 4096
+#define STATS_BUFFER_SIZE 65536
+
+struct Job;
+
+// One slice of one tuple of a job. Slots are padded so workers finishing
+// neighbouring slices do not write to the same cache line.
+struct RangeTask {
+  struct PoolTask base;
+  struct Job *job;
+  int item;
+  struct FactorialArgs args;
+  struct BlockIndex *index;
+  uint64_t result;
+} __attribute__((aligned(64)));
+
+// One request frame handed from the event loop to the pool and back. The
+// connection is identified by fd plus generation, so a reply for a client
+// that disconnected meanwhile is dropped instead of reaching a new client
+// that reused the descriptor. Jobs are recycled through a free list owned
+// by the event loop, together with their task slots.
+struct Job {
+  struct PoolTask plan;
+  struct Job *next;
+  int fd;
+  uint64_t generation;
+  uint64_t id;
+  uint64_t received_ns;
+  uint64_t numbers;
+  uint16_t count;
+  struct FactorialArgs items[PROTOCOL_MAX_BATCH];
+  uint64_t results[PROTOCOL_MAX_BATCH];
+  struct BlockIndex *indexes[PROTOCOL_MAX_BATCH];
+  int pending;
+  struct RangeTask *tasks;
+  int tasks_num;
+  int tasks_capacity;
+};
+
+// Finished jobs, pushed by workers and drained by the event loop after it
+// is woken through event_fd.
+struct CompletionQueue {
+  pthread_mutex_t lock;
+  struct Job *head;
+  struct Job *tail;
+  int event_fd;
+};
+
+// Per-client state. Every complete frame in the input buffer becomes a
+// job right away, as long as its reply is guaranteed to fit into the
+// output buffer: out_reserved counts the bytes promised to jobs still
+// running. Replies go out in completion order.
+struct Connection {
+  int fd;
+  uint64_t generation;
+  char in[INPUT_BUFFER_SIZE];
+  size_t in_len;
+  char out[OUTPUT_BUFFER_SIZE];
+  size_t out_len;
+  size_t out_reserved;
+  int jobs;
+  bool peer_closed;
+  bool read_blocked;
+  // Set after a protocol error: input is ignored and the connection is
+  // closed once the error frame and pending replies are sent.
+  bool closing;
+};
+
+static int tnum = -1;
+static int epoll_fd = -1;
+static struct ThreadPool pool;
+static struct Job *free_jobs = NULL;
+static struct BlockIndexCache block_indexes;
+static bool use_index = false;
+static struct CompletionQueue completions = {PTHREAD_MUTEX_INITIALIZER, NULL,
+                                             NULL, -1};
+static struct Connection **connections = NULL;
+static int connections_cap = 0;
+static uint64_t next_generation = 1;
+static struct ServerMetrics metrics;
+
+static void CompleteJob(struct Job *job) {
+  pthread_mutex_lock(&completions.lock);
+  job->next = NULL;
+  if (completions.tail)
+    completions.tail->next = job;
+  else
+    completions.head = job;
+  completions.tail = job;
+  pthread_mutex_unlock(&completions.lock);
+
+  uint64_t one = 1;
+  write(completions.event_fd, &one, sizeof(one));
+}
+
+static void RunRangeTask(struct PoolTask *base) {
+  struct RangeTask *task = (struct RangeTask *)base;
+  struct Job *job = task->job;
+  uint64_t started_ns = MetricsNow();
+
+  if (task->args.begin > task->args.end)
+    task->result = 1 % task->args.mod;
+  else if (task->index)
+    task->result = BlockIndexRangeProduct(&block_indexes, task->index,
+                                          task->args.begin, task->args.end);
+  else
+    task->result = Factorial(&task->args);
+
+  uint64_t elapsed_ns = MetricsNow() - started_ns;
+  struct WorkerMetrics *worker = MetricsWorker(&metrics);
+  MetricsAdd(&worker->tasks, 1);
+  if (task->args.begin <= task->args.end)
+    MetricsAdd(&worker->numbers, task->args.end - task->args.begin + 1);
+  MetricsAdd(&worker->busy_ns, elapsed_ns);
+  HistogramRecord(&worker->task_ns, elapsed_ns);
+
+  // The worker that finishes the last slice combines the slots.
+  if (__atomic_sub_fetch(&job->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    for (int i = 0; i < job->tasks_num; i++) {
+      const struct RangeTask *done = &job->tasks[i];
+      job->results[done->item] = MultModulo(job->results[done->item],
+                                            done->result, done->args.mod);
+    }
+    for (int i = 0; i < job->count; i++) {
+      if (job->indexes[i])
+        BlockIndexRelease(&block_indexes, job->indexes[i]);
+    }
+    CompleteJob(job);
+  }
+}
+
+static struct RangeTask *AddTasks(struct Job *job, int count) {
+  if (job->tasks_num + count > job->tasks_capacity) {
+    int capacity = job->tasks_capacity * 2;
+    while (capacity < job->tasks_num + count)
+      capacity *= 2;
+    struct RangeTask *tasks =
+        aligned_alloc(64, sizeof(struct RangeTask) * capacity);
+    memcpy(tasks, job->tasks, sizeof(struct RangeTask) * job->tasks_num);
+    free(job->tasks);
+    job->tasks = tasks;
+    job->tasks_capacity = capacity;
+  }
+  struct RangeTask *tasks = &job->tasks[job->tasks_num];
+  job->tasks_num += count;
+  return tasks;
+}
 
-  for (uint64_t i = args->begin; i <= args->end; i++) {
-    ans = MultModulo(ans, i, args->mod);
+// Splits tuple item into up to tnum slices. With an index the inner cuts
+// are moved down to block boundaries so every block lands in one slice
+// and gets stored.
+static void PlanItem(struct Job *job, int item) {
+  const struct FactorialArgs *args = &job->items[item];
+  uint64_t length = args->end - args->begin + 1;
+  uint64_t slices64 = length / MIN_SLICE_LENGTH;
+  int slices = slices64 < 1 ? 1 : slices64 > (uint64_t)tnum ? tnum
+                                                            : (int)slices64;
+
+  struct BlockIndex *index =
+      use_index ? BlockIndexAcquire(&block_indexes, args->mod) : NULL;
+  job->indexes[item] = index;
+  job->results[item] = 1 % args->mod;
+
+  // Slice i covers (cut(i), cut(i + 1)].
+  struct RangeTask *tasks = AddTasks(job, slices);
+  uint64_t previous_cut = args->begin - 1;
+  for (int i = 0; i < slices; i++) {
+    uint64_t cut = args->end;
+    if (i < slices - 1) {
+      cut = args->begin - 1 +
+            (uint64_t)((unsigned __int128)length * (i + 1) / slices);
+      if (index)
+        cut -= cut % block_indexes.block_size;
+      if (cut < previous_cut)
+        cut = previous_cut;
+    }
+
+    struct RangeTask *task = &tasks[i];
+    task->base.run = RunRangeTask;
+    task->job = job;
+    task->item = item;
+    task->index = index;
+    task->args.begin = previous_cut + 1;
+    task->args.end = cut;
+    task->args.mod = args->mod;
+    previous_cut = cut;
   }
+}
 
-  return ans;
+// First stage of every job: answers the tuples the fast path covers
+// directly, then fans the rest out over the pool.
+static void PlanJob(struct PoolTask *base) {
+  struct Job *job = (struct Job *)base;
+
+  job->tasks_num = 0;
+  for (int i = 0; i < job->count; i++) {
+    const struct FactorialArgs *args = &job->items[i];
+    job->indexes[i] = NULL;
+    if (args->mod == 0 || args->begin > args->end)
+      job->results[i] = args->mod ? 1 % args->mod : 0;
+    else if (FactorialFastPath(args->begin, args->end, args->mod,
+                               &job->results[i]))
+      MetricsAdd(&MetricsWorker(&metrics)->fast_path, 1);
+    else
+      PlanItem(job, i);
+  }
+
+  if (job->tasks_num == 0) {
+    CompleteJob(job);
+    return;
+  }
+  // Every slot must be filled in before the first one can finish.
+  job->pending = job->tasks_num;
+  int tasks_num = job->tasks_num;
+  for (int i = 0; i < tasks_num; i++)
+    ThreadPoolSubmit(&pool, &job->tasks[i].base);
 }
 
-void *ThreadFactorial(void *args) {
-  struct FactorialArgs *fargs = (struct FactorialArgs *)args;
-  uint64_t *result = malloc(sizeof(uint64_t));
-  *result = Factorial(fargs);
-  return (void *)result;
+static struct Job *AllocJob(void) {
+  struct Job *job = free_jobs;
+  if (job) {
+    free_jobs = job->next;
+    return job;
+  }
+  job = malloc(sizeof(struct Job));
+  job->tasks_capacity = tnum;
+  job->tasks = aligned_alloc(64, sizeof(struct RangeTask) * tnum);
+  return job;
+}
+
+static void ReleaseJob(struct Job *job) {
+  job->next = free_jobs;
+  free_jobs = job;
+}
+
+// Hands the job to the pool; the reply is sent once it shows up in the
+// completion queue.
+static void SubmitJob(struct Job *job) {
+  job->plan.run = PlanJob;
+  ThreadPoolSubmit(&pool, &job->plan);
+}
+
+static bool SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void CloseConnection(struct Connection *conn) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+  shutdown(conn->fd, SHUT_RDWR);
+  close(conn->fd);
+  connections[conn->fd] = NULL;
+  free(conn);
+  MetricsAdd(&metrics.connections_open, -1);
+}
+
+// Returns false if the connection failed and was closed.
+static bool FlushOutput(struct Connection *conn) {
+  size_t sent = 0;
+  while (sent < conn->out_len) {
+    ssize_t n = send(conn->fd, conn->out + sent, conn->out_len - sent,
+                     MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+      MetricsAdd(&metrics.bytes_out, n);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      fprintf(stderr, "Can't send data to client\n");
+      CloseConnection(conn);
+      return false;
+    }
+  }
+  memmove(conn->out, conn->out + sent, conn->out_len - sent);
+  conn->out_len -= sent;
+  return true;
+}
+
+// Edge-triggered: reads until the socket is drained or the buffer is full.
+// Returns false if the connection failed and was closed.
+static bool ReadInput(struct Connection *conn) {
+  conn->read_blocked = false;
+  while (!conn->peer_closed) {
+    if (conn->in_len == sizeof(conn->in)) {
+      conn->read_blocked = true;
+      break;
+    }
+    ssize_t n = recv(conn->fd, conn->in + conn->in_len,
+                     sizeof(conn->in) - conn->in_len, 0);
+    if (n > 0) {
+      conn->in_len += n;
+      MetricsAdd(&metrics.bytes_in, n);
+    } else if (n == 0) {
+      conn->peer_closed = true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else {
+      fprintf(stderr, "Client read failed\n");
+      CloseConnection(conn);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Answers a malformed frame with an error frame and stops reading; the
+// stream cannot be resynchronized after a bad length.
+static void RejectInput(struct Connection *conn, uint64_t id,
+                        enum ProtocolError error) {
+  fprintf(stderr, "Client sent a bad frame: %s\n", ProtocolErrorName(error));
+  MetricsAdd(&metrics.protocol_errors, 1);
+  conn->closing = true;
+  conn->in_len = 0;
+  if (conn->out_len + conn->out_reserved + FRAME_HEADER_SIZE +
+          sizeof(uint32_t) <= sizeof(conn->out))
+    conn->out_len += EncodeError(conn->out + conn->out_len, id, error);
+}
+
+// Starts a job for every complete request frame that has room for its
+// reply, and closes the connection once the client hung up (or was
+// rejected) and everything was answered.
+static void ProcessInput(struct Connection *conn) {
+  if (conn->closing)
+    conn->in_len = 0;
+  while (!conn->closing) {
+    size_t offset = 0;
+    while (conn->in_len - offset >= FRAME_HEADER_SIZE) {
+      struct FrameHeader header;
+      enum ProtocolError error =
+          DecodeFrameHeader(conn->in + offset, &header);
+      if (error == PROTOCOL_OK && header.type != FRAME_REQUEST)
+        error = PROTOCOL_BAD_TYPE;
+      if (error != PROTOCOL_OK) {
+        RejectInput(conn, header.id, error);
+        break;
+      }
+
+      size_t frame_size = FRAME_HEADER_SIZE + header.length;
+      size_t reply_size = FRAME_HEADER_SIZE + header.count * FRAME_RESULT_SIZE;
+      if (conn->in_len - offset < frame_size ||
+          conn->out_len + conn->out_reserved + reply_size > sizeof(conn->out))
+        break;
+
+      struct Job *job = AllocJob();
+      job->fd = conn->fd;
+      job->generation = conn->generation;
+      job->id = header.id;
+      job->received_ns = MetricsNow();
+      job->count = header.count;
+      DecodeRequestItems(conn->in + offset + FRAME_HEADER_SIZE, header.count,
+                         job->items);
+      offset += frame_size;
+
+      job->numbers = 0;
+      for (int i = 0; i < job->count; i++) {
+        const struct FactorialArgs *item = &job->items[i];
+        if (item->begin <= item->end)
+          job->numbers += item->end - item->begin + 1;
+        fprintf(stdout, "Receive: %llu %llu %llu\n", item->begin, item->end,
+                item->mod);
+      }
+      MetricsAdd(&metrics.frames, 1);
+      MetricsAdd(&metrics.tuples, job->count);
+
+      conn->out_reserved += reply_size;
+      conn->jobs++;
+      SubmitJob(job);
+    }
+    if (conn->closing)
+      break;
+
+    conn->in_len -= offset;
+    memmove(conn->in, conn->in + offset, conn->in_len);
+    // A full buffer stopped reading; the socket may hold more frames.
+    if (offset == 0 || !conn->read_blocked)
+      break;
+    if (!ReadInput(conn))
+      return;
+  }
+
+  if (conn->closing && conn->out_len > 0 && !FlushOutput(conn))
+    return;
+  if ((conn->peer_closed || conn->closing) && conn->jobs == 0 &&
+      conn->out_len == 0) {
+    if (conn->in_len > 0)
+      fprintf(stderr, "Client send wrong data format\n");
+    CloseConnection(conn);
+  }
+}
+
+static void DrainCompletions(void) {
+  uint64_t count;
+  read(completions.event_fd, &count, sizeof(count));
+
+  pthread_mutex_lock(&completions.lock);
+  struct Job *job = completions.head;
+  completions.head = completions.tail = NULL;
+  pthread_mutex_unlock(&completions.lock);
+
+  while (job) {
+    struct Job *next = job->next;
+    struct Connection *conn =
+        job->fd < connections_cap ? connections[job->fd] : NULL;
+
+    for (int i = 0; i < job->count; i++)
+      printf("Total: %llu\n", job->results[i]);
+    MetricsAdd(&metrics.replies, 1);
+    HistogramRecord(&metrics.latency_ns[SizeClassOf(job->numbers)],
+                    MetricsNow() - job->received_ns);
+
+    if (conn && conn->generation == job->generation) {
+      size_t reply_size = EncodeResponse(conn->out + conn->out_len, job->id,
+                                         job->results, job->count);
+      conn->out_len += reply_size;
+      conn->out_reserved -= reply_size;
+      conn->jobs--;
+      if (FlushOutput(conn))
+        ProcessInput(conn);
+    }
+    ReleaseJob(job);
+    job = next;
+  }
+}
+
+static void AcceptConnections(int server_fd) {
+  while (true) {
+    struct sockaddr_in client;
+    socklen_t client_len = sizeof(client);
+    int client_fd = accept(server_fd, (struct sockaddr *)&client, &client_len);
+
+    if (client_fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        fprintf(stderr, "Could not establish new connection\n");
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+
+    if (!SetNonBlocking(client_fd)) {
+      close(client_fd);
+      continue;
+    }
+
+    if (client_fd >= connections_cap) {
+      int new_cap = connections_cap ? connections_cap : 64;
+      while (new_cap <= client_fd)
+        new_cap *= 2;
+      connections = realloc(connections, sizeof(*connections) * new_cap);
+      for (int i = connections_cap; i < new_cap; i++)
+        connections[i] = NULL;
+      connections_cap = new_cap;
+    }
+
+    MetricsAdd(&metrics.connections_accepted, 1);
+    MetricsAdd(&metrics.connections_open, 1);
+
+    struct Connection *conn = calloc(1, sizeof(struct Connection));
+    conn->fd = client_fd;
+    conn->generation = next_generation++;
+    connections[client_fd] = conn;
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = client_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) < 0) {
+      fprintf(stderr, "Could not watch new connection\n");
+      CloseConnection(conn);
+    }
+  }
+}
+
+// Every connection to the stats port gets one plain-text snapshot and is
+// closed; the text is small enough for the socket buffer.
+static void ServeStats(int stats_fd) {
+  static char text[STATS_BUFFER_SIZE];
+  while (true) {
+    int client_fd = accept(stats_fd, NULL, NULL);
+    if (client_fd < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    size_t len = MetricsFormat(&metrics, text, sizeof(text));
+    send(client_fd, text, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(client_fd);
+  }
+}
+
+static void PrintStats(int signal_fd) {
+  static char text[STATS_BUFFER_SIZE];
+  struct signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    size_t len = MetricsFormat(&metrics, text, sizeof(text));
+    fwrite(text, 1, len, stdout);
+    fflush(stdout);
+  }
+}
+
+// Listens on 127.0.0.1 only; the stats are not meant for other hosts.
+static int ListenForStats(int port) {
+  int stats_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (stats_fd < 0)
+    return -1;
+
+  struct sockaddr_in addr;
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t)port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int opt_val = 1;
+  setsockopt(stats_fd, SOL_SOCKET, SO_REUSEADDR, &opt_val, sizeof(opt_val));
+  if (bind(stats_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(stats_fd, 16) < 0 || !SetNonBlocking(stats_fd)) {
+    close(stats_fd);
+    return -1;
+  }
+  return stats_fd;
 }
 
 int main(int argc, char **argv) {
-  int tnum = -1;
   int port = -1;
+  int index_mb = DEFAULT_INDEX_MB;
+  uint64_t index_block = DEFAULT_INDEX_BLOCK;
+  int stats_port = 0;
 
   while (true) {
     int current_optind = optind ? optind : 1;
 
     static struct option options[] = {{"port", required_argument, 0, 0},
                                       {"tnum", required_argument, 0, 0},
+                                      {"index_mb", required_argument, 0, 0},
+                                      {"index_block", required_argument, 0, 0},
+                                      {"stats_port", required_argument, 0, 0},
                                       {0, 0, 0, 0}};
 
     int option_index = 0;
@@ -56,6 +588,18 @@ int main(int argc, char **argv) {
       case 1:
         tnum = atoi(optarg);
         break;
+      case 2:
+        index_mb = atoi(optarg);
+        break;
+      case 3:
+        if (!ConvertStringToUI64(optarg, &index_block) || index_block == 0) {
+          fprintf(stderr, "index_block must be a positive number\n");
+          return 1;
+        }
+        break;
+      case 4:
+        stats_port = atoi(optarg);
+        break;
       default:
         printf("Index %d is out of options\n", option_index);
       }
@@ -70,10 +614,18 @@ int main(int argc, char **argv) {
   }
 
   if (port == -1 || tnum == -1) {
-    fprintf(stderr, "Using: %s --port 20001 --tnum 4\n", argv[0]);
+    fprintf(stderr,
+            "Using: %s --port 20001 --tnum 4 [--index_mb 64] "
+            "[--index_block 4096] [--stats_port 20100]\n",
+            argv[0]);
     return 1;
   }
 
+  // --index_mb 0 turns the block-product index off.
+  use_index = index_mb > 0;
+  BlockIndexCacheInit(&block_indexes, index_block,
+                      (uint64_t)(use_index ? index_mb : 0) << 20);
+
   int server_fd = socket(AF_INET, SOCK_STREAM, 0);
   if (server_fd < 0) {
     fprintf(stderr, "Can not create server socket!");
@@ -100,89 +652,100 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  // SIGUSR1 is read through a signalfd by the event loop, so it has to
+  // stay blocked in every thread, including the workers started next.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  MetricsInit(&metrics, tnum > 0 ? tnum : 1);
+  if (tnum <= 0 || !ThreadPoolInit(&pool, tnum)) {
+    fprintf(stderr, "Could not start the worker pool\n");
+    return 1;
+  }
+
   printf("Server listening at %d with %d threads\n", port, tnum);
 
-  while (true) {
-    struct sockaddr_in client;
-    socklen_t client_len = sizeof(client);
-    int client_fd = accept(server_fd, (struct sockaddr *)&client, &client_len);
+  epoll_fd = epoll_create1(0);
+  completions.event_fd = eventfd(0, EFD_NONBLOCK);
+  if (epoll_fd < 0 || completions.event_fd < 0 || signal_fd < 0 ||
+      !SetNonBlocking(server_fd)) {
+    fprintf(stderr, "Could not set up the event loop\n");
+    return 1;
+  }
 
-    if (client_fd < 0) {
-      fprintf(stderr, "Could not establish new connection\n");
-      continue;
+  // --stats_port 0 leaves the stats port closed; SIGUSR1 always works.
+  int stats_fd = -1;
+  if (stats_port > 0) {
+    stats_fd = ListenForStats(stats_port);
+    if (stats_fd < 0) {
+      fprintf(stderr, "Could not listen for stats on port %d\n", stats_port);
+      return 1;
     }
+    printf("Stats at 127.0.0.1:%d\n", stats_port);
+  }
 
-    while (true) {
-      unsigned int buffer_size = sizeof(uint64_t) * 3;
-      char from_client[buffer_size];
-      int read_bytes = recv(client_fd, from_client, buffer_size, 0);
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLET;
+  event.data.fd = server_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event);
+  event.events = EPOLLIN | EPOLLET;
+  event.data.fd = completions.event_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, completions.event_fd, &event);
+  event.events = EPOLLIN;
+  event.data.fd = signal_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+  if (stats_fd >= 0) {
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = stats_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stats_fd, &event);
+  }
 
-      if (!read_bytes)
-        break;
-      if (read_bytes < 0) {
-        fprintf(stderr, "Client read failed\n");
-        break;
+  struct epoll_event events[MAX_EVENTS];
+  while (true) {
+    int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      return 1;
+    }
+
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+      if (fd == server_fd) {
+        AcceptConnections(server_fd);
+        continue;
       }
-      if (read_bytes < buffer_size) {
-        fprintf(stderr, "Client send wrong data format\n");
-        break;
+      if (fd == completions.event_fd) {
+        DrainCompletions();
+        continue;
       }
-
-      pthread_t threads[tnum];
-
-      uint64_t begin = 0;
-      uint64_t end = 0;
-      uint64_t mod = 0;
-      memcpy(&begin, from_client, sizeof(uint64_t));
-      memcpy(&end, from_client + sizeof(uint64_t), sizeof(uint64_t));
-      memcpy(&mod, from_client + 2 * sizeof(uint64_t), sizeof(uint64_t));
-
-      fprintf(stdout, "Receive: %llu %llu %llu\n", begin, end, mod);
-
-      struct FactorialArgs args[tnum];
-      uint64_t range_size = (end - begin + 1) / tnum;
-      uint64_t remainder = (end - begin + 1) % tnum;
-      uint64_t current = begin;
-
-      for (uint32_t i = 0; i < tnum; i++) {
-        args[i].begin = current;
-        args[i].end = current + range_size - 1;
-        if (i < remainder) {
-          args[i].end++;
-        }
-        args[i].mod = mod;
-        
-        current = args[i].end + 1;
-
-        if (pthread_create(&threads[i], NULL, ThreadFactorial, (void *)&args[i])) {
-          fprintf(stderr, "Error: pthread_create failed!\n");
-          return 1;
-        }
+      if (fd == signal_fd) {
+        PrintStats(signal_fd);
+        continue;
       }
-
-      uint64_t total = 1;
-      for (uint32_t i = 0; i < tnum; i++) {
-        uint64_t *result = NULL;
-        pthread_join(threads[i], (void **)&result);
-        if (result) {
-          total = MultModulo(total, *result, mod);
-          free(result);
-        }
+      if (fd == stats_fd) {
+        ServeStats(stats_fd);
+        continue;
       }
 
-      printf("Total: %llu\n", total);
-
-      char buffer[sizeof(total)];
-      memcpy(buffer, &total, sizeof(total));
-      err = send(client_fd, buffer, sizeof(total), 0);
-      if (err < 0) {
-        fprintf(stderr, "Can't send data to client\n");
-        break;
+      struct Connection *conn = fd < connections_cap ? connections[fd] : NULL;
+      if (!conn)
+        continue;
+      if (events[i].events & EPOLLERR) {
+        CloseConnection(conn);
+        continue;
       }
+      if ((events[i].events & EPOLLOUT) && !FlushOutput(conn))
+        continue;
+      if ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) &&
+          !ReadInput(conn))
+        continue;
+      ProcessInput(conn);
     }
-
-    shutdown(client_fd, SHUT_RDWR);
-    close(client_fd);
   }
 
   return 0;